@@ -0,0 +1,534 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../EMObsReaderCore/EMObsReader.h"
+#include "ArrowExport.h"
+
+namespace fs = std::filesystem;
+
+// main.cpp
+std::wstring RowTypeToString(RowType type);
+
+
+// Arrow format constants (Schema.fbs, Message.fbs and File.fbs in the Arrow format spec)
+#define ARROW_METADATA_V5           4
+#define ARROW_HEADER_SCHEMA         1
+#define ARROW_HEADER_DICTIONARY     2
+#define ARROW_HEADER_RECORDBATCH    3
+#define ARROW_TYPE_INT              2
+#define ARROW_TYPE_FLOATINGPOINT    3
+#define ARROW_TYPE_UTF8             5
+#define ARROW_PRECISION_DOUBLE      2
+
+
+/// <summary>
+/// Minimal FlatBuffers builder, enough for the Arrow metadata. Like the real builder the buffer is
+/// built back to front, so a table's children (strings, vectors, sub tables) must be created
+/// before the table. References to an object are its distance from the end of the buffer.
+/// The host is assumed to be little endian, as FlatBuffers and Arrow are
+/// </summary>
+class FlatBuilder {
+public:
+    FlatBuilder() : buf(1024), head(1024) {}
+
+    uint32_t Size() const { return (uint32_t)(buf.size() - head); }
+    const uint8_t* Data() const { return buf.data() + head; }
+
+    uint32_t CreateString(const std::string& s) {
+        Align(4, s.size() + 1);
+        Pad(1);
+        PushBytes(s.data(), s.size());
+        Push<uint32_t>((uint32_t)s.size());
+        return Size();
+    }
+
+    uint32_t CreateOffsetVector(const std::vector<uint32_t>& refs) {
+        Align(4, refs.size() * 4);
+        for (size_t i = refs.size(); i > 0; i--)
+            PushOffset(refs[i - 1]);
+        Push<uint32_t>((uint32_t)refs.size());
+        return Size();
+    }
+
+    // Vector of structs, all the Arrow structs used here are 8 byte aligned
+    template <typename T>
+    uint32_t CreateStructVector(const std::vector<T>& items) {
+        Align(8, items.size() * sizeof(T));
+        PushBytes(items.data(), items.size() * sizeof(T));
+        Push<uint32_t>((uint32_t)items.size());
+        return Size();
+    }
+
+    void StartTable() {
+        fields.clear();
+        tableStart = Size();
+    }
+
+    template <typename T>
+    void AddScalar(int id, T value) {
+        Push<T>(value);
+        fields.push_back({ id, Size() });
+    }
+
+    void AddOffset(int id, uint32_t ref) {
+        PushOffset(ref);
+        fields.push_back({ id, Size() });
+    }
+
+    uint32_t EndTable() {
+        // The table starts with the (signed) offset back to its vtable, filled in below
+        Push<int32_t>(0);
+        uint32_t tableEnd = Size();
+
+        int count = 0;
+        for (const _Field& field : fields)
+            count = std::max(count, field.id + 1);
+
+        std::vector<uint16_t> vtable(count, 0);
+        for (const _Field& field : fields)
+            vtable[field.id] = (uint16_t)(tableEnd - field.at);
+
+        for (int i = count; i > 0; i--)
+            Push<uint16_t>(vtable[i - 1]);
+        Push<uint16_t>((uint16_t)(tableEnd - tableStart));
+        Push<uint16_t>((uint16_t)((count + 2) * sizeof(uint16_t)));
+
+        int32_t vtableOffset = (int32_t)(Size() - tableEnd);
+        memcpy(&buf[buf.size() - tableEnd], &vtableOffset, sizeof(vtableOffset));
+
+        return tableEnd;
+    }
+
+    void Finish(uint32_t root) {
+        Align(std::max<size_t>(minAlign, 8), 4);
+        PushOffset(root);
+    }
+
+private:
+    struct _Field {
+        int id;
+        uint32_t at;
+    };
+
+    std::vector<uint8_t> buf;   // The built bytes are buf[head..]
+    size_t head;
+    size_t minAlign = 1;
+    uint32_t tableStart = 0;
+    std::vector<_Field> fields;
+
+    void Reserve(size_t n) {
+        if (head >= n)
+            return;
+
+        size_t grow = std::max(buf.size(), n);
+        std::vector<uint8_t> larger(buf.size() + grow);
+        memcpy(larger.data() + head + grow, buf.data() + head, Size());
+        buf.swap(larger);
+        head += grow;
+    }
+
+    void Pad(size_t n) {
+        Reserve(n);
+        while (n-- > 0)
+            buf[--head] = 0;
+    }
+
+    // Pad so the next len bytes pushed end on an alignment boundary
+    void Align(size_t alignment, size_t len = 0) {
+        minAlign = std::max(minAlign, alignment);
+        Pad((alignment - ((Size() + len) % alignment)) % alignment);
+    }
+
+    void PushBytes(const void* data, size_t size) {
+        Reserve(size);
+        head -= size;
+        memcpy(&buf[head], data, size);
+    }
+
+    template <typename T>
+    void Push(T value) {
+        Align(sizeof(T));
+        PushBytes(&value, sizeof(T));
+    }
+
+    void PushOffset(uint32_t ref) {
+        Align(4);
+        Push<uint32_t>(Size() + 4 - ref);
+    }
+};
+
+
+// Arrow structs
+struct _ArrowFieldNode {
+    int64_t length;
+    int64_t nullCount;
+};
+
+struct _ArrowBuffer {
+    int64_t offset;
+    int64_t length;
+};
+
+struct _ArrowBlock {
+    int64_t offset;
+    int32_t metaDataLength;
+    int32_t padding;
+    int64_t bodyLength;
+};
+
+
+enum class ArrowColumnKind {
+    Int32,
+    Float64,
+    Dictionary      // Utf8 values, int32 indices
+};
+
+
+/// <summary>
+/// One column of the export. Dictionary columns keep each distinct string once (as UTF-8) and
+/// an int32 index per row
+/// </summary>
+class ArrowColumn {
+public:
+    ArrowColumn(const char* _name, ArrowColumnKind _kind) : name(_name), kind(_kind) {}
+
+    void Int(int32_t value) { ints.push_back(value); }
+    void Double(double value) { doubles.push_back(value); }
+
+    void String(const std::wstring& value) {
+        auto found = dictionary.find(value);
+        if (found != dictionary.end()) {
+            ints.push_back(found->second);
+            return;
+        }
+
+        int32_t index = (int32_t)dictionaryOffsets.size();
+        dictionary.emplace(value, index);
+        dictionaryOffsets.push_back((int32_t)dictionaryData.size());
+        EMObsAppendUTF8(dictionaryData, value.data(), value.size());
+        ints.push_back(index);
+    }
+
+    const char* name;
+    ArrowColumnKind kind;
+    int64_t dictionaryId = -1;
+
+    std::vector<int32_t> ints;                  // Int32 values or dictionary indices
+    std::vector<double> doubles;                // Float64 values
+    std::vector<int32_t> dictionaryOffsets;     // Start of each distinct string in dictionaryData
+    std::string dictionaryData;
+
+private:
+    std::unordered_map<std::wstring, int32_t> dictionary;
+};
+
+
+/// <summary>
+/// The body of a message, the buffers are written straight from the columns each padded to 8 bytes
+/// </summary>
+class ArrowBody {
+public:
+    void Add(const void* data, size_t size) {
+        buffers.push_back({ (int64_t)length, (int64_t)size });
+        parts.push_back({ data, size });
+        length += (size + 7) & ~(size_t)7;
+    }
+
+    void AddNode(int64_t rows) {
+        nodes.push_back({ rows, 0 });
+    }
+
+    void Write(std::ofstream& out) const {
+        static const char zeros[8] = {};
+        for (const _Part& part : parts) {
+            out.write((const char*)part.data, part.size);
+            out.write(zeros, ((part.size + 7) & ~(size_t)7) - part.size);
+        }
+    }
+
+    std::vector<_ArrowFieldNode> nodes;
+    std::vector<_ArrowBuffer> buffers;
+    size_t length = 0;
+
+private:
+    struct _Part {
+        const void* data;
+        size_t size;
+    };
+    std::vector<_Part> parts;
+};
+
+
+static uint32_t BuildArrowIntType(FlatBuilder& fb, int32_t bitWidth) {
+    fb.StartTable();
+    fb.AddScalar<int32_t>(0, bitWidth);     // bitWidth
+    fb.AddScalar<uint8_t>(1, 1);            // is_signed
+    return fb.EndTable();
+}
+
+
+static uint32_t BuildArrowSchema(FlatBuilder& fb, const std::vector<ArrowColumn>& columns) {
+
+    std::vector<uint32_t> fieldRefs;
+
+    for (const ArrowColumn& column : columns) {
+        uint32_t nameRef = fb.CreateString(column.name);
+        uint32_t childrenRef = fb.CreateOffsetVector({});
+
+        uint32_t typeRef;
+        uint8_t typeType;
+        uint32_t dictionaryRef = 0;
+
+        switch (column.kind) {
+        case ArrowColumnKind::Int32:
+            typeRef = BuildArrowIntType(fb, 32);
+            typeType = ARROW_TYPE_INT;
+            break;
+        case ArrowColumnKind::Float64:
+            fb.StartTable();
+            fb.AddScalar<int16_t>(0, ARROW_PRECISION_DOUBLE);
+            typeRef = fb.EndTable();
+            typeType = ARROW_TYPE_FLOATINGPOINT;
+            break;
+        default: {
+            fb.StartTable();
+            typeRef = fb.EndTable();
+            typeType = ARROW_TYPE_UTF8;
+
+            uint32_t indexTypeRef = BuildArrowIntType(fb, 32);
+            fb.StartTable();
+            fb.AddScalar<int64_t>(0, column.dictionaryId);     // id
+            fb.AddOffset(1, indexTypeRef);                      // indexType
+            dictionaryRef = fb.EndTable();
+            break;
+        }
+        }
+
+        fb.StartTable();
+        fb.AddOffset(0, nameRef);                   // name
+        fb.AddScalar<uint8_t>(1, 0);                // nullable
+        fb.AddScalar<uint8_t>(2, typeType);         // type_type
+        fb.AddOffset(3, typeRef);                   // type
+        if (dictionaryRef != 0)
+            fb.AddOffset(4, dictionaryRef);         // dictionary
+        fb.AddOffset(5, childrenRef);               // children
+        fieldRefs.push_back(fb.EndTable());
+    }
+
+    uint32_t fieldsRef = fb.CreateOffsetVector(fieldRefs);
+    fb.StartTable();
+    fb.AddOffset(1, fieldsRef);                     // fields (endianness defaults to Little)
+    return fb.EndTable();
+}
+
+
+static uint32_t BuildArrowRecordBatch(FlatBuilder& fb, int64_t rows, const ArrowBody& body) {
+    uint32_t nodesRef = fb.CreateStructVector(body.nodes);
+    uint32_t buffersRef = fb.CreateStructVector(body.buffers);
+
+    fb.StartTable();
+    fb.AddScalar<int64_t>(0, rows);                 // length
+    fb.AddOffset(1, nodesRef);                      // nodes
+    fb.AddOffset(2, buffersRef);                    // buffers
+    return fb.EndTable();
+}
+
+
+/// <summary>
+/// Write an encapsulated message: the continuation marker, the metadata length, the Message
+/// flatbuffer padded to 8 bytes and then the body. Returns the file block of the message
+/// </summary>
+static _ArrowBlock WriteArrowMessage(std::ofstream& out, int64_t& fileOffset, FlatBuilder& fb,
+    uint8_t headerType, uint32_t headerRef, const ArrowBody* body) {
+
+    int64_t bodyLength = body != nullptr ? (int64_t)body->length : 0;
+
+    fb.StartTable();
+    fb.AddScalar<int64_t>(3, bodyLength);           // bodyLength
+    fb.AddOffset(2, headerRef);                     // header
+    fb.AddScalar<int16_t>(0, ARROW_METADATA_V5);    // version
+    fb.AddScalar<uint8_t>(1, headerType);           // header_type
+    fb.Finish(fb.EndTable());
+
+    static const char zeros[8] = {};
+    int32_t metaDataLength = (int32_t)((fb.Size() + 7) & ~7u);
+    uint32_t continuation = 0xFFFFFFFF;
+
+    out.write((const char*)&continuation, sizeof(continuation));
+    out.write((const char*)&metaDataLength, sizeof(metaDataLength));
+    out.write((const char*)fb.Data(), fb.Size());
+    out.write(zeros, metaDataLength - fb.Size());
+    if (body != nullptr)
+        body->Write(out);
+
+    _ArrowBlock block = { fileOffset, metaDataLength + 8, 0, bodyLength };
+    fileOffset += block.metaDataLength + bodyLength;
+    return block;
+}
+
+
+int ExportArrowFile(const fs::path& fileSpec, const std::list<struct _OutputRow*>& rows) {
+
+    // The columns in the same order as the text export
+    std::vector<ArrowColumn> columns = {
+        { "Row", ArrowColumnKind::Int32 },
+        { "PathEMObs", ArrowColumnKind::Dictionary },
+        { "FileEMObs", ArrowColumnKind::Dictionary },
+        { "OpCode", ArrowColumnKind::Dictionary },
+        { "RowType", ArrowColumnKind::Dictionary },
+        { "Period", ArrowColumnKind::Dictionary },
+        { "Path", ArrowColumnKind::Dictionary },
+        { "FileL", ArrowColumnKind::Dictionary },
+        { "FileLStatus", ArrowColumnKind::Dictionary },
+        { "FrameL", ArrowColumnKind::Int32 },
+        { "PointLX1", ArrowColumnKind::Float64 },
+        { "PointLY1", ArrowColumnKind::Float64 },
+        { "PointLX2", ArrowColumnKind::Float64 },
+        { "PointLY2", ArrowColumnKind::Float64 },
+        { "FileR", ArrowColumnKind::Dictionary },
+        { "FileRStatus", ArrowColumnKind::Dictionary },
+        { "FrameR", ArrowColumnKind::Int32 },
+        { "PointRX1", ArrowColumnKind::Float64 },
+        { "PointRY1", ArrowColumnKind::Float64 },
+        { "PointRX2", ArrowColumnKind::Float64 },
+        { "PointRY2", ArrowColumnKind::Float64 },
+        { "Length", ArrowColumnKind::Float64 },
+        { "Family", ArrowColumnKind::Dictionary },
+        { "Genus", ArrowColumnKind::Dictionary },
+        { "Species", ArrowColumnKind::Dictionary },
+        { "Count", ArrowColumnKind::Int32 }
+    };
+
+    int64_t dictionaryId = 0;
+    for (ArrowColumn& column : columns) {
+        if (column.kind == ArrowColumnKind::Dictionary)
+            column.dictionaryId = dictionaryId++;
+    }
+
+    // Fill the columns
+    for (const struct _OutputRow* item : rows) {
+        columns[0].Int(item->row);
+        columns[1].String(item->PathEMObs);
+        columns[2].String(item->FileEMObs);
+        columns[3].String(item->opCode);
+        columns[4].String(RowTypeToString(item->rowType));
+        columns[5].String(item->Period);
+        columns[6].String(item->Path);
+        columns[7].String(item->FileL);
+        columns[8].String(item->FileLStatus);
+        columns[9].Int((int32_t)item->FrameL);
+        columns[10].Double(item->PointLX1);
+        columns[11].Double(item->PointLY1);
+        columns[12].Double(item->PointLX2);
+        columns[13].Double(item->PointLY2);
+        columns[14].String(item->FileR);
+        columns[15].String(item->FileRStatus);
+        columns[16].Int((int32_t)item->FrameR);
+        columns[17].Double(item->PointRX1);
+        columns[18].Double(item->PointRY1);
+        columns[19].Double(item->PointRX2);
+        columns[20].Double(item->PointRY2);
+        columns[21].Double(item->Length);
+        columns[22].String(item->Family);
+        columns[23].String(item->Genus);
+        columns[24].String(item->Species);
+        columns[25].Int(item->count);
+    }
+
+    std::ofstream out(fileSpec, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        std::cerr << "Error: Unable to open output file for the EMObs data export: " << fileSpec << std::endl;
+        return -1;
+    }
+
+    // The file starts with the magic, padded to 8 bytes, and then is an Arrow IPC stream
+    out.write("ARROW1\0\0", 8);
+    int64_t fileOffset = 8;
+
+    {
+        FlatBuilder fb;
+        WriteArrowMessage(out, fileOffset, fb, ARROW_HEADER_SCHEMA, BuildArrowSchema(fb, columns), nullptr);
+    }
+
+    // One dictionary batch per dictionary column
+    std::vector<_ArrowBlock> dictionaryBlocks;
+
+    for (ArrowColumn& column : columns) {
+        if (column.kind != ArrowColumnKind::Dictionary)
+            continue;
+
+        int64_t count = (int64_t)column.dictionaryOffsets.size();
+        column.dictionaryOffsets.push_back((int32_t)column.dictionaryData.size());
+
+        ArrowBody body;
+        body.AddNode(count);
+        body.Add(nullptr, 0);                                   // No validity bitmap, no nulls
+        body.Add(column.dictionaryOffsets.data(), column.dictionaryOffsets.size() * sizeof(int32_t));
+        body.Add(column.dictionaryData.data(), column.dictionaryData.size());
+
+        FlatBuilder fb;
+        uint32_t dataRef = BuildArrowRecordBatch(fb, count, body);
+        fb.StartTable();
+        fb.AddScalar<int64_t>(0, column.dictionaryId);          // id
+        fb.AddOffset(1, dataRef);                               // data
+        uint32_t batchRef = fb.EndTable();
+
+        dictionaryBlocks.push_back(WriteArrowMessage(out, fileOffset, fb, ARROW_HEADER_DICTIONARY, batchRef, &body));
+    }
+
+    // The rows in record batches
+    std::vector<_ArrowBlock> recordBlocks;
+
+    for (size_t first = 0; first < rows.size(); first += ARROW_BATCH_ROWS) {
+        size_t count = std::min(rows.size() - first, (size_t)ARROW_BATCH_ROWS);
+
+        ArrowBody body;
+        for (const ArrowColumn& column : columns) {
+            body.AddNode((int64_t)count);
+            body.Add(nullptr, 0);
+            if (column.kind == ArrowColumnKind::Float64)
+                body.Add(column.doubles.data() + first, count * sizeof(double));
+            else
+                body.Add(column.ints.data() + first, count * sizeof(int32_t));
+        }
+
+        FlatBuilder fb;
+        uint32_t batchRef = BuildArrowRecordBatch(fb, (int64_t)count, body);
+        recordBlocks.push_back(WriteArrowMessage(out, fileOffset, fb, ARROW_HEADER_RECORDBATCH, batchRef, &body));
+    }
+
+    // End of stream marker
+    uint32_t endOfStream[2] = { 0xFFFFFFFF, 0 };
+    out.write((const char*)endOfStream, sizeof(endOfStream));
+
+    // The footer repeats the schema and indexes the batches so readers can go straight to them
+    FlatBuilder fb;
+    uint32_t schemaRef = BuildArrowSchema(fb, columns);
+    uint32_t dictionariesRef = fb.CreateStructVector(dictionaryBlocks);
+    uint32_t recordBatchesRef = fb.CreateStructVector(recordBlocks);
+    fb.StartTable();
+    fb.AddOffset(1, schemaRef);                     // schema
+    fb.AddOffset(2, dictionariesRef);               // dictionaries
+    fb.AddOffset(3, recordBatchesRef);              // recordBatches
+    fb.AddScalar<int16_t>(0, ARROW_METADATA_V5);    // version
+    fb.Finish(fb.EndTable());
+
+    int32_t footerLength = (int32_t)fb.Size();
+    out.write((const char*)fb.Data(), fb.Size());
+    out.write((const char*)&footerLength, sizeof(footerLength));
+    out.write("ARROW1", 6);
+
+    out.close();
+    if (out.fail()) {
+        std::cerr << "Error: Unable to write the EMObs data export: " << fileSpec << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <filesystem>
+#include <list>
+
+
+/// <summary>
+/// Writes the data export (the _OutputRow rows) as an Apache Arrow IPC file (the .arrow/Feather
+/// v2 format) instead of tab delimited text. The coordinates, frames, counts and row numbers are
+/// native numeric columns and every text column (opcode, period, file, species...) is dictionary
+/// encoded, so the file can be memory mapped by the analysis tools without parsing anything.
+/// The rows go in record batches of up to ARROW_BATCH_ROWS rows, all sharing one dictionary per
+/// column.
+/// </summary>
+
+#define ARROW_BATCH_ROWS 65536
+
+// Write rows to fileSpec (replacing it). Returns 0 if ok
+int ExportArrowFile(const std::filesystem::path& fileSpec, const std::list<struct _OutputRow*>& rows);
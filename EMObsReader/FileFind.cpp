@@ -1,12 +1,59 @@
-#include <windows.h>  // For GetFileAttributesW and file attribute constants
+#ifdef _WIN32
+#include <windows.h>  // For FindFirstFileExW and file attribute constants
+#endif
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <cwctype>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
 #include "FileFind.h"
 
 namespace fs = std::filesystem;
 
+
+#define FILEFIND_INDEX_HEADER "EMObsMediaIndex\t1"
+
+
+/// <summary>
+/// The index key of a directory, its absolute path
+/// </summary>
+static std::wstring DirectoryKey(const fs::path& directory) {
+
+    std::error_code error;
+    fs::path absolute = fs::absolute(directory, error);
+    return error ? directory.wstring() : absolute.wstring();
+}
+
+
 FileFind::FileFind() : searchStarted(false), currentIterator(endIterator) {}
 
 FileFind::~FileFind() {}
 
+void FileFind::SetThreads(unsigned int _threads) {
+
+    threads = std::max(1u, _threads);
+}
+
+void FileFind::SetIndex(const std::filesystem::path& _indexFileSpec) {
+
+    indexFileSpec = _indexFileSpec;
+}
+
+size_t FileFind::GetDirectoriesListed() const {
+
+    return directoriesListed;
+}
+
+size_t FileFind::GetDirectoriesReused() const {
+
+    return directoriesReused;
+}
+
 int FileFind::ScanFiles(const std::wstring& searchPath) {
     int ret = 0;
 
@@ -16,43 +63,316 @@ int FileFind::ScanFiles(const std::wstring& searchPath) {
         return -2;
     }
 
-    try {
-        for (const auto& entry : fs::recursive_directory_iterator(searchPath, fs::directory_options::skip_permission_denied)) {
-            try {
-                // Get the file or directory attributes
-                DWORD attributes = GetFileAttributesW(entry.path().c_str());
-
-                // Check if the entry is hidden or a system file, and skip it if so
-                if (attributes != INVALID_FILE_ATTRIBUTES && (attributes & (FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM))) {
-                    continue;  // Skip hidden or system files/directories
-                }
-
-                // Process regular files
-                if (fs::is_regular_file(entry.path())) {
-                    std::wstring fileName = entry.path().filename().wstring();
-                    std::wstring fullPath = entry.path().wstring();
-                    uintmax_t fileSize = fs::file_size(entry.path());
-
-                    // Convert the filename to uppercase
-                    std::transform(fileName.begin(), fileName.end(), fileName.begin(), towupper);
-
-                    // Insert file information into the dictionary
-                    fileDictionary[fileName].push_back({ fullPath, fileSize });
-                }
-            }
-            catch (const fs::filesystem_error& ex) {
+    if (!indexFileSpec.empty())
+        LoadIndex();
+
+    // The scan time is taken before any directory is listed
+    long long scanTime = fs::file_time_type::clock::now().time_since_epoch().count();
+
+    WalkDirectories(path);
+    if (directories.find(DirectoryKey(path)) == directories.end()) {
+        std::wcout << L"FileFind::ScanFiles() File system error: unable to list " << searchPath << std::endl;
+        indexedDirectories.clear();
+        return -1;
+    }
+
+    // Add the files in the order a recursive walk of the tree would find them
+    AddDirectory(path);
+
+    if (!indexFileSpec.empty()) {
+        indexScanTime = scanTime;
+        SaveIndex(path);
+    }
+
+    indexedDirectories.clear();
+
+    return ret;
+}
+
+
+/// <summary>
+/// List the files and sub-directories of directory, skipping hidden and system files. Links to
+/// directories aren't followed. Returns 0 if ok, 1 if access was denied (skipped quietly) or -1
+/// </summary>
+int FileFind::ListDirectory(const fs::path& directory, std::vector<_FileIndexEntry>& entries) {
+
+#ifdef _WIN32
+    // The attributes, size and modified time all come with the directory listing
+    WIN32_FIND_DATAW data;
+    HANDLE find = FindFirstFileExW((directory / L"*").c_str(), FindExInfoBasic, &data, FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+    if (find == INVALID_HANDLE_VALUE)
+        return GetLastError() == ERROR_ACCESS_DENIED ? 1 : -1;
+
+    do {
+        if (wcscmp(data.cFileName, L".") == 0 || wcscmp(data.cFileName, L"..") == 0)
+            continue;
+
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            if (!(data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT))
+                entries.push_back({ data.cFileName, true, 0, 0 });
+        }
+        else if (!(data.dwFileAttributes & (FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM))) {
+            uintmax_t size = ((uintmax_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+            long long modified = ((long long)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+            entries.push_back({ data.cFileName, false, size, modified });
+        }
+    } while (FindNextFileW(find, &data));
+
+    FindClose(find);
+#else
+    std::error_code error;
+    fs::directory_iterator iterator(directory, fs::directory_options::skip_permission_denied, error);
+    if (error)
+        return error == std::errc::permission_denied ? 1 : -1;
+
+    for (; iterator != fs::directory_iterator(); iterator.increment(error)) {
+        const fs::directory_entry& entry = *iterator;
+        std::error_code entryError;
+
+        if (entry.is_directory(entryError) && !entry.is_symlink(entryError)) {
+            entries.push_back({ entry.path().filename().wstring(), true, 0, 0 });
+        }
+        else if (entry.is_regular_file(entryError)) {
+            uintmax_t size = entry.file_size(entryError);
+            long long modified = entry.last_write_time(entryError).time_since_epoch().count();
+            if (entryError) {
                 // Handle errors for specific files and skip over them
-                std::wcout << L"Error processing file: " << entry.path().wstring() << L" - " << ex.what() << std::endl;
+                std::wcout << L"Error processing file: " << entry.path().wstring() << L" - " << entryError.message().c_str() << std::endl;
                 continue;
             }
+            entries.push_back({ entry.path().filename().wstring(), false, size, modified });
+        }
+    }
+    if (error)
+        return -1;
+#endif
+
+    return 0;
+}
+
+/// <summary>
+/// List root and every directory under it on the pool of threads. A directory with the same
+/// modified time as in the index (and not changed within FILEFIND_RACY_SECONDS of the last scan)
+/// reuses the indexed entries instead of being listed
+/// </summary>
+void FileFind::WalkDirectories(const fs::path& root) {
+
+    directories.clear();
+    directoriesListed = 0;
+    directoriesReused = 0;
+
+    long long racyTicks = std::chrono::duration_cast<fs::file_time_type::duration>(std::chrono::seconds(FILEFIND_RACY_SECONDS)).count();
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<fs::path> pending = { root };
+    unsigned int busy = 0;
+
+    auto worker = [&]() {
+        while (true) {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&]() { return !pending.empty() || busy == 0; });
+            if (pending.empty())
+                break;
+
+            fs::path directory = pending.front();
+            pending.pop_front();
+            busy++;
+            lock.unlock();
+
+            std::wstring key = DirectoryKey(directory);
+            std::error_code error;
+            _FileIndexDirectory listing;
+            listing.modified = fs::last_write_time(directory, error).time_since_epoch().count();
+
+            auto indexed = indexedDirectories.find(key);
+            bool reused = !error && indexed != indexedDirectories.end() && indexed->second.modified == listing.modified &&
+                listing.modified < indexScanTime - racyTicks;
+
+            int ret = 0;
+            if (reused)
+                listing.entries = indexed->second.entries;
+            else
+                ret = ListDirectory(directory, listing.entries);
+
+            if (ret < 0)
+                std::wcout << L"Error processing directory: " << directory.wstring() << std::endl;
+
+            lock.lock();
+            for (const _FileIndexEntry& entry : listing.entries) {
+                if (entry.directory)
+                    pending.push_back(directory / entry.name);
+            }
+            if (ret == 0) {
+                // A directory that couldn't be read isn't kept, so it's listed again next time
+                directories[key] = std::move(listing);
+                if (reused)
+                    directoriesReused++;
+                else
+                    directoriesListed++;
+            }
+            busy--;
+            lock.unlock();
+            changed.notify_all();
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned int t = 0; t < threads; t++)
+        pool.emplace_back(worker);
+
+    for (std::thread& thread : pool)
+        thread.join();
+}
+
+/// <summary>
+/// Add the files of directory to the dictionary, descending into each sub-directory where it
+/// was listed
+/// </summary>
+void FileFind::AddDirectory(const fs::path& directory) {
+
+    auto listing = directories.find(DirectoryKey(directory));
+    if (listing == directories.end())
+        return;
+
+    for (const _FileIndexEntry& entry : listing->second.entries) {
+        fs::path entryPath = directory / entry.name;
+
+        if (entry.directory) {
+            AddDirectory(entryPath);
+            continue;
         }
+
+        // Convert the filename to uppercase
+        std::wstring fileName = entry.name;
+        std::transform(fileName.begin(), fileName.end(), fileName.begin(), towupper);
+
+        // Insert file information into the dictionary
+        fileDictionary[fileName].push_back({ entryPath.wstring(), entry.size });
     }
-    catch (const fs::filesystem_error& ex) {
-        std::wcout << L"FileFind::ScanFiles() File system error: " << ex.what() << std::endl;
-        ret = -1;
+}
+
+
+/// <summary>
+/// Read the index written by the last scan. The index is a UTF-8 text file, after the header
+/// line (with the scan time) each directory is a line "D modified path" followed by a line for
+/// each of its entries, "F size modified name" for a file and "S name" for a sub-directory, all
+/// tab delimited. Returns false if there isn't a usable index, then every directory is listed
+/// </summary>
+bool FileFind::LoadIndex() {
+
+    indexedDirectories.clear();
+    indexScanTime = 0;
+
+    std::ifstream file(indexFileSpec);
+    if (!file.is_open())
+        return false;
+
+    std::string line;
+    if (!std::getline(file, line) || line.compare(0, strlen(FILEFIND_INDEX_HEADER "\t"), FILEFIND_INDEX_HEADER "\t") != 0) {
+        std::wcout << L"Ignoring the media index, it isn't in the expected format: " << indexFileSpec.wstring() << std::endl;
+        return false;
     }
 
-    return ret;
+    const char* end = line.data() + line.size();
+    std::from_chars(line.data() + strlen(FILEFIND_INDEX_HEADER "\t"), end, indexScanTime);
+
+    // Split the line at the first fields tabs, the last field is the rest of the line
+    auto split = [](const std::string& text, std::string* fields, int count) {
+        size_t start = 0;
+        for (int i = 0; i < count - 1; i++) {
+            size_t tab = text.find('\t', start);
+            if (tab == std::string::npos)
+                return false;
+            fields[i] = text.substr(start, tab - start);
+            start = tab + 1;
+        }
+        fields[count - 1] = text.substr(start);
+        return true;
+    };
+
+    auto number = [](const std::string& text, auto& value) {
+        std::from_chars_result result = std::from_chars(text.data(), text.data() + text.size(), value);
+        return result.ec == std::errc() && result.ptr == text.data() + text.size();
+    };
+
+    _FileIndexDirectory* directory = nullptr;
+    std::string fields[4];
+
+    while (std::getline(file, line)) {
+        bool ok = false;
+
+        if (line.compare(0, 2, "D\t") == 0 && split(line, fields, 3)) {
+            _FileIndexDirectory& added = indexedDirectories[EMObsFromUTF8(fields[2])];
+            added.entries.clear();
+            ok = number(fields[1], added.modified);
+            directory = &added;
+        }
+        else if (directory != nullptr && line.compare(0, 2, "F\t") == 0 && split(line, fields, 4)) {
+            _FileIndexEntry entry = { EMObsFromUTF8(fields[3]), false, 0, 0 };
+            ok = number(fields[1], entry.size) && number(fields[2], entry.modified);
+            if (ok)
+                directory->entries.push_back(std::move(entry));
+        }
+        else if (directory != nullptr && line.compare(0, 2, "S\t") == 0 && split(line, fields, 2)) {
+            directory->entries.push_back({ EMObsFromUTF8(fields[1]), true, 0, 0 });
+            ok = true;
+        }
+
+        if (!ok) {
+            std::wcout << L"Ignoring the media index, it is damaged: " << indexFileSpec.wstring() << std::endl;
+            indexedDirectories.clear();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Write the directories of this scan to the index, replacing it
+/// </summary>
+void FileFind::SaveIndex(const fs::path& root) {
+
+    // Written alongside and renamed over the index, so a run that stops part way leaves the last index
+    fs::path tempFileSpec = indexFileSpec;
+    tempFileSpec += ".tmp";
+
+    EMObsUTF8Writer out;
+    if (!out.Open(tempFileSpec)) {
+        std::wcout << L"Error: Unable to write the media index: " << indexFileSpec.wstring() << std::endl;
+        return;
+    }
+
+    out << FILEFIND_INDEX_HEADER "\t" << std::to_string(indexScanTime) << "\n";
+    SaveDirectory(out, root);
+    out.Close();
+
+    std::error_code error;
+    fs::rename(tempFileSpec, indexFileSpec, error);
+    if (error)
+        std::wcout << L"Error: Unable to write the media index: " << indexFileSpec.wstring() << L" - " << error.message().c_str() << std::endl;
+}
+
+void FileFind::SaveDirectory(EMObsUTF8Writer& out, const fs::path& directory) {
+
+    std::wstring key = DirectoryKey(directory);
+    auto listing = directories.find(key);
+    if (listing == directories.end())
+        return;
+
+    out << "D\t" << std::to_string(listing->second.modified) << "\t" << key << "\n";
+    for (const _FileIndexEntry& entry : listing->second.entries) {
+        if (entry.directory)
+            out << "S\t" << entry.name << "\n";
+        else
+            out << "F\t" << std::to_string(entry.size) << "\t" << std::to_string(entry.modified) << "\t" << entry.name << "\n";
+    }
+
+    for (const _FileIndexEntry& entry : listing->second.entries) {
+        if (entry.directory)
+            SaveDirectory(out, directory / entry.name);
+    }
 }
 
 
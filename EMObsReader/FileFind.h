@@ -6,19 +6,43 @@
 #include <regex>
 #include <iostream>
 
+#include "../EMObsReaderCore/EMObsUTF8.h"
+
+
+#define FILEFIND_THREADS 8          // Directories listed at once, the walk waits on the disk (or the NAS), not the CPU
+#define FILEFIND_RACY_SECONDS 2     // An indexed directory changed this close to the last scan is listed again
+
 
 struct FileItem {
     std::wstring fileSpec;
     uintmax_t fileSize;
 };
 
+/// <summary>
+/// Finds files by name anywhere under a search path. ScanFiles() lists the directories on a pool
+/// of threads, each thread taking the next directory waiting and queuing its sub-directories.
+/// With SetIndex() the name, size, modified time and path of every file are kept in an index
+/// file. The next scan reuses the entries of each directory whose modified time hasn't changed
+/// and only lists the directories that have (a file added, removed or renamed), so only the
+/// directories themselves are checked. A file rewritten in place doesn't change its directory.
+/// </summary>
 class FileFind {
 public:
     FileFind();
     ~FileFind();
 
+    // Threads listing directories (default FILEFIND_THREADS)
+    void SetThreads(unsigned int _threads);
+
+    // Keep the index in indexFileSpec, off if empty
+    void SetIndex(const std::filesystem::path& _indexFileSpec);
+
     int ScanFiles(const std::wstring& searchPath);
 
+    // Directories listed and directories reused from the index by the last ScanFiles()
+    size_t GetDirectoriesListed() const;
+    size_t GetDirectoriesReused() const;
+
     // New member functions for finding files with a filter
     std::vector<FileItem> FindFirst(const std::wstring& searchFilter);
     std::vector<FileItem> FindNext();
@@ -26,8 +50,38 @@ public:
     std::vector<FileItem> getFileInfo(const std::wstring& fileName);
 
 private:
+    // A file or sub-directory of a directory, in the order they are listed
+    struct _FileIndexEntry {
+        std::wstring name;
+        bool directory;
+        uintmax_t size;
+        long long modified;     // File time ticks
+    };
+
+    struct _FileIndexDirectory {
+        long long modified;     // Of the directory itself
+        std::vector<_FileIndexEntry> entries;
+    };
+
+    static int ListDirectory(const std::filesystem::path& directory, std::vector<_FileIndexEntry>& entries);
+    void WalkDirectories(const std::filesystem::path& root);
+    void AddDirectory(const std::filesystem::path& directory);
+    bool LoadIndex();
+    void SaveIndex(const std::filesystem::path& root);
+    void SaveDirectory(EMObsUTF8Writer& out, const std::filesystem::path& directory);
+
     std::unordered_map<std::wstring, std::vector<FileItem>> fileDictionary;
 
+    unsigned int threads = FILEFIND_THREADS;
+    std::filesystem::path indexFileSpec;
+
+    // The directories of this scan and the last (from the index), by absolute path
+    std::unordered_map<std::wstring, _FileIndexDirectory> directories;
+    std::unordered_map<std::wstring, _FileIndexDirectory> indexedDirectories;
+    long long indexScanTime = 0;
+    size_t directoriesListed = 0;
+    size_t directoriesReused = 0;
+
     // For FindFirst/FindNext functionality
     std::unordered_map<std::wstring, std::vector<FileItem>>::iterator currentIterator;
     std::unordered_map<std::wstring, std::vector<FileItem>>::iterator endIterator;
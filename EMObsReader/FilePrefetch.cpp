@@ -0,0 +1,73 @@
+#include <filesystem>
+#include "FilePrefetch.h"
+
+namespace fs = std::filesystem;
+
+FilePrefetch::FilePrefetch(const std::vector<std::string>& _files, size_t _depth) : files(_files), depth(_depth) {
+
+    if (depth < 1)
+        depth = 1;
+
+    thread = std::thread(&FilePrefetch::Run, this);
+}
+
+FilePrefetch::~FilePrefetch() {
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    readyChanged.notify_all();
+
+    thread.join();
+}
+
+/// <summary>
+/// Background thread. Read the files in order, waiting whenever depth files are already waiting
+/// </summary>
+void FilePrefetch::Run() {
+
+    for (const std::string& file : files) {
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            readyChanged.wait(lock, [this]() { return stop || ready.size() < depth; });
+            if (stop)
+                return;
+        }
+
+        // Leave a missing file to the caller so the error is reported in the usual place
+        std::shared_ptr<EMObsBufferFile> source;
+        std::error_code ec;
+        if (fs::is_regular_file(file, ec)) {
+            source = std::make_shared<EMObsBufferFile>();
+            if (source->Read(file) != 0)
+                source = nullptr;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ready.push_back(source);
+        }
+        readyChanged.notify_all();
+    }
+}
+
+std::shared_ptr<EMObsFileSource> FilePrefetch::Next() {
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    if (taken >= files.size())
+        return nullptr;
+
+    readyChanged.wait(lock, [this]() { return !ready.empty(); });
+
+    std::shared_ptr<EMObsFileSource> source = ready.front();
+    ready.pop_front();
+    taken++;
+
+    lock.unlock();
+    readyChanged.notify_all();
+
+    return source;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../EMObsReaderCore/EMObsFileSource.h"
+
+
+/// <summary>
+/// Reads a list of files into memory on a background thread, ahead of the parser. At most depth
+/// files are read and waiting at any time, so while file N is parsed files N+1 (and N+2) are
+/// being read and the disk is kept busy. The files must be taken with Next() in list order.
+/// </summary>
+class FilePrefetch {
+public:
+    FilePrefetch(const std::vector<std::string>& _files, size_t _depth = 2);
+    ~FilePrefetch();
+
+    // Wait for the next file in the list. nullptr if it could not be read or there are no more
+    // files, the caller can then open the file itself
+    std::shared_ptr<EMObsFileSource> Next();
+
+private:
+    void Run();
+
+    std::vector<std::string> files;
+    size_t depth;
+    size_t taken = 0;                                   // Files returned by Next()
+
+    std::deque<std::shared_ptr<EMObsFileSource>> ready; // Read and waiting, in list order
+    bool stop = false;
+    std::mutex mutex;
+    std::condition_variable readyChanged;
+    std::thread thread;
+};
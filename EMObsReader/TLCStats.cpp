@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "../EMObsReaderCore/EMObsSchema.h"
+#include "../EMObsReaderCore/EMObsTLCScan.h"
+#include "TLCStats.h"
+#include "TSVWriter.h"
+
+
+void TLCStats::AddFile(const unsigned char* buffer, size_t size) {
+
+    files++;
+    bytes += size;
+
+    // The TLC before the current one, its size is only known once the next one is found
+    _TLCStat* previous = nullptr;
+    long previousPos = 0;
+
+    long pos = TLCScanFindNext(buffer, size, 0);
+    while (pos != -1) {
+        uint32_t key = EMObsTLC((const char*)&buffer[pos]) | ((uint32_t)buffer[pos + 3] << 24);
+
+        if (previous != nullptr)
+            previous->sizes[(uint32_t)(pos - previousPos)]++;
+
+        _TLCStat& stat = stats[key];
+        stat.count++;
+        if (stat.lastFile != files) {
+            stat.files++;
+            stat.lastFile = files;
+        }
+
+        previous = &stat;
+        previousPos = pos;
+
+        // A TLC can't overlap the next one (the version byte isn't a letter or digit)
+        pos = TLCScanFindNext(buffer, size, pos + 4);
+    }
+
+    if (previous != nullptr)
+        previous->sizes[(uint32_t)(size - previousPos)]++;
+}
+
+void TLCStats::AddFailedFile() {
+
+    failedFiles++;
+}
+
+void TLCStats::Merge(const TLCStats& other) {
+
+    for (const auto& item : other.stats) {
+        _TLCStat& stat = stats[item.first];
+        stat.count += item.second.count;
+        stat.files += item.second.files;
+        for (const auto& size : item.second.sizes)
+            stat.sizes[size.first] += size.second;
+    }
+
+    files += other.files;
+    failedFiles += other.failedFiles;
+    bytes += other.bytes;
+}
+
+/// <summary>
+/// Status of a TLC and version: Known, UnknownVersion (a known TLC with a version the reader
+/// doesn't decode) or UnknownTLC (most likely record data that happens to look like a TLC)
+/// </summary>
+static const char* TLCStatus(uint32_t tlc, char version) {
+
+    if (EMObsFindRecordInfo(tlc, version) != nullptr)
+        return "Known";
+    else if (EMObsIsKnownTLC(tlc))
+        return "UnknownVersion";
+    else
+        return "UnknownTLC";
+}
+
+// Sorted by TLC (alphabetically) then version
+std::vector<uint32_t> TLCStats::SortedKeys() const {
+
+    std::vector<uint32_t> keys;
+    keys.reserve(stats.size());
+    for (const auto& item : stats)
+        keys.push_back(item.first);
+
+    auto order = [](uint32_t key) {
+        return ((key & 0xFF) << 24) | (((key >> 8) & 0xFF) << 16) | (((key >> 16) & 0xFF) << 8) | (key >> 24);
+    };
+    std::sort(keys.begin(), keys.end(), [&](uint32_t a, uint32_t b) { return order(a) < order(b); });
+
+    return keys;
+}
+
+void TLCStats::Write(EMObsUTF8Writer& out) const {
+
+    TSVWriter writer(out);
+
+    const char* headings[] = { "TLC", "Version", "Status", "Files", "Count", "MinSize", "MedianSize", "MaxSize" };
+    for (const char* heading : headings)
+        writer.String(heading, strlen(heading));
+    writer.EndRow();
+
+    for (uint32_t key : SortedKeys()) {
+        const _TLCStat& stat = stats.at(key);
+        uint32_t tlc = key & 0xFFFFFF;
+        char version = (char)(key >> 24);
+        char name[3] = { (char)(tlc & 0xFF), (char)((tlc >> 8) & 0xFF), (char)(tlc >> 16) };
+
+        // The (lower) median from the size histogram
+        std::vector<std::pair<uint32_t, long long>> sizes(stat.sizes.begin(), stat.sizes.end());
+        std::sort(sizes.begin(), sizes.end());
+
+        long long middle = (stat.count - 1) / 2;
+        uint32_t median = 0;
+        for (const auto& size : sizes) {
+            if (middle < size.second) {
+                median = size.first;
+                break;
+            }
+            middle -= size.second;
+        }
+
+        const char* status = TLCStatus(tlc, version);
+
+        writer.String(name, 3);
+        writer.Int(version);
+        writer.String(status, strlen(status));
+        writer.Int(stat.files);
+        writer.Int(stat.count);
+        writer.Int(sizes.empty() ? 0 : sizes.front().first);
+        writer.Int(median);
+        writer.Int(sizes.empty() ? 0 : sizes.back().first);
+        writer.EndRow();
+    }
+}
+
+void TLCStats::Report() const {
+
+    long long tlcs = 0;
+    for (const auto& item : stats)
+        tlcs += item.second.count;
+
+    std::cout << "Stats: " << files << " files, " << bytes / (1024 * 1024) << " MB, " << tlcs << " TLCs, "
+        << stats.size() << " TLC and version pairs" << std::endl;
+    if (failedFiles > 0)
+        std::cout << "    " << failedFiles << " file(s) could not be read" << std::endl;
+
+    // Unknown versions of known TLCs are listed, the unknown TLCs are mostly record data that
+    // looks like a TLC so only their number is given
+    size_t unknownTLCs = 0;
+    for (uint32_t key : SortedKeys()) {
+        uint32_t tlc = key & 0xFFFFFF;
+        char version = (char)(key >> 24);
+        if (EMObsFindRecordInfo(tlc, version) != nullptr)
+            continue;
+        if (!EMObsIsKnownTLC(tlc)) {
+            unknownTLCs++;
+            continue;
+        }
+
+        const _TLCStat& stat = stats.at(key);
+        std::cout << "    Unknown version: " << (char)(tlc & 0xFF) << (char)((tlc >> 8) & 0xFF) << (char)(tlc >> 16) << " v" << (int)version
+            << "  Count: " << stat.count << "  Files: " << stat.files << std::endl;
+    }
+
+    if (unknownTLCs > 0)
+        std::cout << "    " << unknownTLCs << " unknown TLC and version pair(s), see the UnknownTLC rows" << std::endl;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "../EMObsReaderCore/EMObsUTF8.h"
+
+
+/// <summary>
+/// TLC statistics over a set of EMObs files (/stats). Every TLC candidate is counted by its TLC
+/// and version byte, with the number of files it turns up in and the distribution of its record
+/// size (the bytes from the TLC to the next TLC or the end of the file, as in the TLC index).
+/// Each thread fills its own TLCStats from the files it scans and they are merged at the end.
+/// </summary>
+class TLCStats {
+public:
+    // Count the TLCs of one file
+    void AddFile(const unsigned char* buffer, size_t size);
+
+    // Count a file that could not be read
+    void AddFailedFile();
+
+    // Add the counts of other (from another thread)
+    void Merge(const TLCStats& other);
+
+    // Write the table, one tab delimited row per TLC and version in TLC order
+    void Write(EMObsUTF8Writer& out) const;
+
+    // Report the totals and the TLCs and versions the reader doesn't know to the console
+    void Report() const;
+
+private:
+    struct _TLCStat {
+        long long count = 0;
+        long long files = 0;
+        size_t lastFile = 0;                                    // Serial of the last file counted in files
+        std::unordered_map<uint32_t, long long> sizes;          // Record size -> count
+    };
+
+    std::vector<uint32_t> SortedKeys() const;
+
+    // Key is the 24 bit TLC with the version byte in the top byte
+    std::unordered_map<uint32_t, _TLCStat> stats;
+    size_t files = 0;
+    size_t failedFiles = 0;
+    unsigned long long bytes = 0;
+};
@@ -0,0 +1,95 @@
+#include <cctype>
+#include <charconv>
+#include "TSVWriter.h"
+
+
+TSVWriter::TSVWriter(EMObsUTF8Writer& _out, size_t _blockSize) : out(_out), blockSize(_blockSize) {
+
+    buffer.reserve(blockSize + 4096);
+}
+
+TSVWriter::~TSVWriter() {
+
+    Flush();
+}
+
+void TSVWriter::String(const std::wstring& value) {
+
+    Separator();
+    EMObsAppendUTF8(buffer, value.data(), value.size());
+}
+
+void TSVWriter::String(const char* value, size_t length) {
+
+    Separator();
+    buffer.append(value, length);
+}
+
+void TSVWriter::EscapedString(const std::wstring& value) {
+
+    Separator();
+
+    // Copy the runs between the tabs
+    size_t start = 0;
+    size_t pos;
+    while ((pos = value.find(L'\t', start)) != std::wstring::npos) {
+        EMObsAppendUTF8(buffer, value.data() + start, pos - start);
+        buffer.append("<Tab>");
+        start = pos + 1;
+    }
+    EMObsAppendUTF8(buffer, value.data() + start, value.size() - start);
+}
+
+void TSVWriter::Int(long long value) {
+
+    Separator();
+
+    char text[24];
+    std::to_chars_result result = std::to_chars(text, text + sizeof(text), value);
+    buffer.append(text, result.ptr);
+}
+
+void TSVWriter::Hex(unsigned long long value, int digits) {
+
+    Separator();
+
+    char text[24];
+    std::to_chars_result result = std::to_chars(text, text + sizeof(text), value, 16);
+    for (int pad = digits - (int)(result.ptr - text); pad > 0; pad--)
+        buffer += '0';
+    for (const char* p = text; p < result.ptr; p++)
+        buffer += (char)toupper((unsigned char)*p);
+}
+
+void TSVWriter::Double(double value) {
+
+    Separator();
+
+    char text[32];
+    std::to_chars_result result = std::to_chars(text, text + sizeof(text), value);
+    buffer.append(text, result.ptr);
+}
+
+void TSVWriter::EndRow() {
+
+    buffer += '\n';
+    rowStarted = false;
+
+    if (buffer.size() >= blockSize)
+        Flush();
+}
+
+void TSVWriter::Flush() {
+
+    if (!buffer.empty()) {
+        out.Write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+}
+
+void TSVWriter::Separator() {
+
+    if (rowStarted)
+        buffer += '\t';
+    rowStarted = true;
+}
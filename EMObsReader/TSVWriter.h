@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+#include "../EMObsReaderCore/EMObsUTF8.h"
+
+
+#define TSV_BLOCK_SIZE (1024 * 1024)    // Bytes buffered before they are written to the file
+
+
+/// <summary>
+/// Formats tab delimited rows as UTF-8 straight into one reusable buffer and writes it to the
+/// file a block at a time, instead of a stringstream and a flush per row. Numbers are formatted with
+/// std::to_chars, doubles as the shortest text that reads back as the same value. The tab
+/// separators are added between the fields of a row, EndRow() ends the row
+/// </summary>
+class TSVWriter {
+public:
+    TSVWriter(EMObsUTF8Writer& _out, size_t _blockSize = TSV_BLOCK_SIZE);
+    ~TSVWriter();
+
+    void String(const std::wstring& value);
+    void String(const char* value, size_t length);    // Already UTF-8
+    void EscapedString(const std::wstring& value);     // Any tabs in value are written as "<Tab>"
+    void Int(long long value);
+    void Hex(unsigned long long value, int digits);     // Upper case, zero padded to digits
+    void Double(double value);
+    void EndRow();
+
+    // Write the buffered rows to the file
+    void Flush();
+
+private:
+    void Separator();
+
+    EMObsUTF8Writer& out;
+    size_t blockSize;
+    std::string buffer;
+    bool rowStarted = false;
+};
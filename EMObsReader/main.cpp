@@ -2,7 +2,6 @@
 //
 
 
-#define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING
 #include <windows.h>  // For GetFileAttributesW and file attribute constants
 #include <iostream>
 #include <vector>
@@ -12,11 +11,24 @@
 #include <regex>
 #include <list>
 #include <sstream>
-#include <locale>
-#include <codecvt>  // For std::wstring_convert
-#include "EMObsReader.h"
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include "../EMObsReaderCore/EMObsReader.h"
+#include "../EMObsReaderCore/EMObsBatchLoader.h"
+#include "../EMObsReaderCore/EMObsTLCScan.h"
+#include "../EMObsReaderCore/EMObsUTF8.h"
+#include "ArrowExport.h"
 #include "FileFind.h"
 #include "FileMapping.h"
+#include "FilePrefetch.h"
+#include "TLCStats.h"
+#include "TSVWriter.h"
 
 namespace fs = std::filesystem;
 
@@ -30,6 +42,13 @@ struct MyStruct {
 #pragma pack(pop) // Restore the previous alignment setting
 
 
+// Format of the data export (/format:<format>)
+enum class OutputFormat {
+    Text,       // Tab delimited text
+    Arrow       // Apache Arrow IPC file
+};
+
+
 struct _Config
 {
 	std::string searchPath;
@@ -39,23 +58,39 @@ struct _Config
     fs::path outputFileTLCList;
     fs::path outputFileTLCHierarchy;
     fs::path outputFileHexDump;
+    fs::path outputFileStats;
     bool dataMode = true;
+    OutputFormat format = OutputFormat::Text;
 	bool appendMode = false;
 	bool tlcMode = false;
 	bool tlcHierarchyMode = false;
 	bool hexDumpMode = false;
+    bool benchScanMode = false;
+    bool statsMode = false;                 // Only write the TLC statistics of the files (/stats)
+    unsigned int prefetch = 2;              // Files read ahead of the parser (/prefetch:N)
+    unsigned int jobs = 1;                  // Threads (/j:N), files parsed at once or one file split
+    TLCScanMode scanMode = TLCScanMode::Auto;
+    EMObsDecodeMode decodeMode = EMObsDecodeMode::Grammar;
+    bool cache = false;                     // Keep a sidecar cache of the rows of each file (/cache[:dir])
+    std::string cacheDirectory;             // Where the sidecars go, next to each file if empty
     fs::path fileMappingFileSpec;
+    bool mediaIndex = false;                // Keep an index of the files under the search path (/index[:file])
+    fs::path mediaIndexFileSpec;
 };
 
 
 struct _Config* parseArguments(int argc, char* argv[]);
 std::string convertWildcardToRegex(const std::string& wildcard);
+std::vector<std::string> findFiles(const std::string& fileSpec, const struct _Config* Config);
 void searchFiles(const std::string& fileSpec, struct _Config* Config, FileMapping fileMapping);
-std::wstring ReplaceTabs(const std::wstring& input);
+int StatsEMObsFiles(const std::vector<std::string>& foundFiles, const struct _Config* Config);
 std::wstring RowTypeToString(RowType type);
-int ExtractEMObsFileTLCs(const std::string foundFile, std::wofstream& outputFileStream, std::list<struct _OutputTLC*>& outputTLCsAdd);
-int ExtractEMObsFileTLCsDisplayHierarchy(const std::string foundFile, std::wofstream& outputFileStream);
-int HexDumpEMObsFile(const std::string foundFile, std::wofstream& outputFileStream);
+int ExtractEMObsFileTLCs(const std::string foundFile, std::shared_ptr<EMObsFileSource> source, EMObsUTF8Writer* outputFileTLCListStream, EMObsUTF8Writer* outputFileTLCHierarchyStream);
+int HexDumpEMObsFile(const std::string foundFile, std::shared_ptr<EMObsFileSource> source, EMObsUTF8Writer& outputFileStream, unsigned int threads);
+int BenchmarkEMObsFileTLCScan(const std::string foundFile, std::shared_ptr<EMObsFileSource> source);
+void ProcessEMObsFilesParallel(const std::vector<std::string>& foundFiles, const struct _Config* Config, std::vector<int>& rets, std::vector<std::list<struct _OutputRow*>>& rows);
+void ForEachEMObsFileParallel(const std::vector<std::string>& foundFiles, unsigned int jobs, const std::function<void(unsigned int thread, size_t i, std::shared_ptr<EMObsFileSource> source)>& process);
+void ReportEMObsFileParseMemory(const EMObsReader& reader);
 
 
 
@@ -72,6 +107,15 @@ int main(int argc, char* argv[]) {
         std::cout << "                            /h                 additionally dump file to hex in the output file" << std::endl;
 		std::cout << "                            /no                don't export the data" << std::endl;
         std::cout << "                            /f:<filemapping>]  two column tab delimited text file to map EMObs video file name to new file name" << std::endl; 
+        std::cout << "                            /format:<format>   data export format: text (tab delimited, the default) or arrow (Apache Arrow IPC file)" << std::endl;
+        std::cout << "                            /scan:<mode>       TLC scanner to use: auto, scalar, sse2 or avx2" << std::endl;
+        std::cout << "                            /cache[:<dir>]     reuse the rows decoded by an earlier run if the file hasn't changed, kept in a sidecar next to each file or in dir" << std::endl;
+        std::cout << "                            /index[:<file>]    keep an index of the media files found (default EMObs_MediaIndex.txt), later runs only re-read the directories that changed" << std::endl;
+        std::cout << "                            /decode:<mode>     find the records by following the record grammar (grammar, the default) or by scanning for each TLC (scan)" << std::endl;
+        std::cout << "                            /j[:N]             use N threads (default: one per core), files are parsed N at once with no record display, a single file is decoded on N threads" << std::endl;
+        std::cout << "                            /prefetch:N        read up to N files ahead of the parser (default: 2, 0 is off)" << std::endl;
+        std::cout << "                            /bench             benchmark the TLC scanners (MB/s) and report the parse tree memory on each file" << std::endl;
+        std::cout << "                            /stats             only write the TLC statistics of all the files (count by version, record sizes, unknown TLCs) to EMObs_Stats.txt, scanned on the /j:N threads" << std::endl;
         return 1;
     }
 
@@ -86,6 +130,16 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
+    if (config->statsMode == true) {
+        std::cout << "Stats mode enabled. TLC statistics to:[" << config->outputFileStats << "]" << std::endl;
+
+        TLCScanMode scanMode = TLCScanSetMode(config->scanMode);
+        std::cout << "TLC scanner: " << TLCScanModeName(scanMode) << std::endl;
+
+        int ret = StatsEMObsFiles(findFiles(convertWildcardToRegex(config->fileSpec), config), config);
+        return ret == 0 ? 0 : 1;
+    }
+
     if (config->outputFileData.empty())
     {
         std::cout << "Use /O:<filespec> to output a tab delimited file." << std::endl;
@@ -104,6 +158,9 @@ int main(int argc, char* argv[]) {
 		std::cout << "Normal mode enabled. All data will be extracted" << std::endl;
 	}
 
+    TLCScanMode scanMode = TLCScanSetMode(config->scanMode);
+    std::cout << "TLC scanner: " << TLCScanModeName(scanMode) << std::endl;
+
     
 	FileMapping fileMapping(config->fileMappingFileSpec.string());
 
@@ -179,6 +236,94 @@ struct _Config* parseArguments(int argc, char* argv[]) {
             if (arg.find("/f:") == 0 || arg.find("/F:") == 0) {
                 config->fileMappingFileSpec = arg.substr(3);  // Extract the file name after "/F:"
             }
+
+            // /FORMAT:<format> switch to select the data export format
+            if (arg.find("/format:") == 0 || arg.find("/FORMAT:") == 0) {
+                std::string format = arg.substr(8);
+                std::transform(format.begin(), format.end(), format.begin(), ::tolower);
+
+                if (format == "arrow")
+                    config->format = OutputFormat::Arrow;
+                else
+                    config->format = OutputFormat::Text;
+            }
+
+            // /SCAN:<mode> switch to select the TLC scanner
+            if (arg.find("/scan:") == 0 || arg.find("/SCAN:") == 0) {
+                std::string mode = arg.substr(6);
+                std::transform(mode.begin(), mode.end(), mode.begin(), ::tolower);
+
+                if (mode == "scalar")
+                    config->scanMode = TLCScanMode::Scalar;
+                else if (mode == "sse2")
+                    config->scanMode = TLCScanMode::SSE2;
+                else if (mode == "avx2")
+                    config->scanMode = TLCScanMode::AVX2;
+                else
+                    config->scanMode = TLCScanMode::Auto;
+            }
+
+            // /CACHE[:<dir>] switch to keep a sidecar cache of the rows
+            if (arg == "/cache" || arg == "/CACHE") {
+                config->cache = true;
+            }
+            else if (arg.find("/cache:") == 0 || arg.find("/CACHE:") == 0) {
+                config->cache = true;
+                config->cacheDirectory = arg.substr(7);
+            }
+
+            // /INDEX[:<file>] switch to keep an index of the media files
+            if (arg == "/index" || arg == "/INDEX") {
+                config->mediaIndex = true;
+            }
+            else if (arg.find("/index:") == 0 || arg.find("/INDEX:") == 0) {
+                config->mediaIndex = true;
+                config->mediaIndexFileSpec = arg.substr(7);
+            }
+
+            // /DECODE:<mode> switch to select how the records are found
+            if (arg.find("/decode:") == 0 || arg.find("/DECODE:") == 0) {
+                std::string mode = arg.substr(8);
+                std::transform(mode.begin(), mode.end(), mode.begin(), ::tolower);
+
+                if (mode == "scan")
+                    config->decodeMode = EMObsDecodeMode::Scan;
+                else
+                    config->decodeMode = EMObsDecodeMode::Grammar;
+            }
+
+            // /J[:N] switch to parse N files at once
+            if (arg == "/j" || arg == "/J") {
+                config->jobs = std::max(1u, std::thread::hardware_concurrency());
+            }
+            else if (arg.find("/j:") == 0 || arg.find("/J:") == 0) {
+                try {
+                    config->jobs = (unsigned int)std::max(1, std::stoi(arg.substr(3)));
+                }
+                catch (const std::exception&) {
+                    std::cerr << "Error: Invalid /j:N value: " << arg << std::endl;
+                }
+            }
+
+            // /PREFETCH:N switch to set how many files are read ahead
+            if (arg.find("/prefetch:") == 0 || arg.find("/PREFETCH:") == 0) {
+                try {
+                    config->prefetch = (unsigned int)std::max(0, std::stoi(arg.substr(10)));
+                }
+                catch (const std::exception&) {
+                    std::cerr << "Error: Invalid /prefetch:N value: " << arg << std::endl;
+                }
+            }
+
+            // /BENCH switch to benchmark the TLC scanners
+            if (arg == "/BENCH" || arg == "/bench") {
+                config->benchScanMode = true;
+            }
+
+            // /STATS switch to only write the TLC statistics
+            if (arg == "/STATS" || arg == "/stats") {
+                config->statsMode = true;
+            }
         }
     }
 
@@ -215,6 +360,8 @@ struct _Config* parseArguments(int argc, char* argv[]) {
         config->outputFileTLCHierarchy = baseFileSpec.string() + "_TLCHierarchy.txt";
     if (config->hexDumpMode)
         config->outputFileHexDump = baseFileSpec.string() + "_HexDump.txt";
+    if (config->statsMode)
+        config->outputFileStats = baseFileSpec.string() + "_Stats.txt";
 
 
 	// If no output file is specified, use the default
@@ -227,7 +374,10 @@ struct _Config* parseArguments(int argc, char* argv[]) {
         if (config->hexDumpMode)
             config->outputFileHexDump = baseFileSpec.string() + "_HexDump.txt";
 
-        config->outputFileData = baseFileSpec.string() + "_Data.txt";        
+        if (config->format == OutputFormat::Arrow)
+            config->outputFileData = baseFileSpec.string() + "_Data.arrow";
+        else
+            config->outputFileData = baseFileSpec.string() + "_Data.txt";
     }
 
 	// If no file mapping file is specified, use the default
@@ -235,6 +385,9 @@ struct _Config* parseArguments(int argc, char* argv[]) {
         config->fileMappingFileSpec = baseFileSpec.string() + "_FileMapping.txt";
     }
 
+    if (config->mediaIndex && config->mediaIndexFileSpec.empty())
+        config->mediaIndexFileSpec = baseFileSpec.string() + "_MediaIndex.txt";
+
 	return config;
 }
 
@@ -262,24 +415,80 @@ std::string convertWildcardToRegex(const std::string& wildcard) {
     return regexPattern;
 }
 
+// Find the files matching fileSpec in the search path (and its sub-directories if /s is specified)
+std::vector<std::string> findFiles(const std::string& fileSpec, const struct _Config* Config) {
+    // Iterate through the directory (recursively if /s is specified)
+    fs::directory_options dirOptions = fs::directory_options::skip_permission_denied;
+    fs::directory_iterator endIter;  // End marker for iteration
+    std::vector<std::string> foundFiles;
+
+    try {
+
+        if (Config->searchSubdirs) {
+            for (const auto& entry : fs::recursive_directory_iterator(Config->searchPath, dirOptions)) {
+
+                // Get the file or directory attributes
+                DWORD attributes = GetFileAttributesW(entry.path().c_str());
+
+                // Check if the entry is hidden or a system file, and skip it if so
+                if (attributes != INVALID_FILE_ATTRIBUTES && (attributes & (FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM))) {
+                    continue;  // Skip hidden or system files/directories
+                }
+
+                if (entry.is_regular_file()) {
+                    if (std::regex_match(entry.path().filename().string(), std::regex(fileSpec))) {
+                        foundFiles.push_back(entry.path().string());
+                    }
+                }
+            }
+        }
+        else {
+            for (const auto& entry : fs::directory_iterator(Config->searchPath, dirOptions)) {
+
+                // Get the file or directory attributes
+                DWORD attributes = GetFileAttributesW(entry.path().c_str());
+
+                // Check if the entry is hidden or a system file, and skip it if so
+                if (attributes != INVALID_FILE_ATTRIBUTES && (attributes & (FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM))) {
+                    continue;  // Skip hidden or system files/directories
+                }
+
+                if (entry.is_regular_file()) {
+                    if (std::regex_match(entry.path().filename().string(), std::regex(fileSpec))) {
+                        foundFiles.push_back(entry.path().string());
+                    }
+                }
+            }
+        }
+    }
+    catch (const fs::filesystem_error& e) {
+        std::cerr << "findFiles() Filesystem error: " << e.what() << std::endl;
+    }
+
+    return foundFiles;
+}
+
+
 // Function to perform the search
 void searchFiles(const std::string& fileSpec, struct _Config* Config, FileMapping fileMapping) {
-    std::wofstream outputFileDataStream;
-	std::wofstream outputFileTLCListStream;
-	std::wofstream outputFileTLCHierarchyStream;
-	std::wofstream outputFileHexDumpStream;
+    EMObsUTF8Writer outputFileDataStream;
+	EMObsUTF8Writer outputFileTLCListStream;
+	EMObsUTF8Writer outputFileTLCHierarchyStream;
+	EMObsUTF8Writer outputFileHexDumpStream;
 
     // Check if the output file already exists
     bool fileExists = fs::exists(Config->outputFileData);
 
+    // The Arrow export is written in one go once all the files are processed
+    bool arrowExport = Config->dataMode == true && Config->format == OutputFormat::Arrow && !Config->outputFileData.empty();
+    if (arrowExport && Config->appendMode)
+        std::cout << "Append mode isn't supported for the Arrow export, the file will be replaced" << std::endl;
+
     // Open the EMObs data export file
-    if (Config->dataMode == true && !Config->outputFileData.empty()) {
-        std::ios_base::openmode mode = std::ios::out;
-        if (Config->appendMode) {
-            mode |= std::ios::app;  // Append if /A is specified
-        }
-        outputFileDataStream.open(Config->outputFileData, mode);
-        if (!outputFileDataStream.is_open()) {
+    if (Config->dataMode == true && !arrowExport && !Config->outputFileData.empty()) {
+        // Append if /A is specified
+        outputFileDataStream.Open(Config->outputFileData, Config->appendMode);
+        if (!outputFileDataStream.IsOpen()) {
             std::cerr << "Error: Unable to open output file for the EMObs data export: " << Config->outputFileData << std::endl;
             return;
         }
@@ -291,8 +500,8 @@ void searchFiles(const std::string& fileSpec, struct _Config* Config, FileMappin
 
     // Open the EMObs TLC List export file if required
     if (Config->tlcMode && !Config->outputFileTLCList.empty()) {
-        outputFileTLCListStream.open(Config->outputFileTLCList, std::ios::out | std::ios::trunc);
-        if (!outputFileTLCListStream.is_open()) {
+        outputFileTLCListStream.Open(Config->outputFileTLCList);
+        if (!outputFileTLCListStream.IsOpen()) {
             std::cerr << "Error: Unable to open output file for the EMObs TLC List export: " << Config->outputFileTLCList << std::endl;
             return;
         }
@@ -302,8 +511,8 @@ void searchFiles(const std::string& fileSpec, struct _Config* Config, FileMappin
 
     // Open the EMObs TLC Hierarchy export file if required
     if (Config->tlcHierarchyMode && !Config->outputFileTLCHierarchy.empty()) {
-        outputFileTLCHierarchyStream.open(Config->outputFileTLCHierarchy, std::ios::out | std::ios::trunc);
-        if (!outputFileTLCHierarchyStream.is_open()) {
+        outputFileTLCHierarchyStream.Open(Config->outputFileTLCHierarchy);
+        if (!outputFileTLCHierarchyStream.IsOpen()) {
             std::cerr << "Error: Unable to open output file for the EMObs TLC List export: " << Config->outputFileTLCHierarchy << std::endl;
             return;
         }
@@ -312,8 +521,8 @@ void searchFiles(const std::string& fileSpec, struct _Config* Config, FileMappin
 
     // Open the EMObs Hex Dump
     if (Config->hexDumpMode && !Config->outputFileHexDump.empty()) {
-        outputFileHexDumpStream.open(Config->outputFileHexDump, std::ios::out | std::ios::trunc);
-        if (!outputFileHexDumpStream.is_open()) {
+        outputFileHexDumpStream.Open(Config->outputFileHexDump);
+        if (!outputFileHexDumpStream.IsOpen()) {
             std::cerr << "Error: Unable to open output file for the EMObs Hex Dump: " << Config->outputFileHexDump << std::endl;
             return;
         }
@@ -322,100 +531,121 @@ void searchFiles(const std::string& fileSpec, struct _Config* Config, FileMappin
 
 
 
-    // Iterate through the directory (recursively if /s is specified)
-    fs::directory_options dirOptions = fs::directory_options::skip_permission_denied;
-    fs::directory_iterator endIter;  // End marker for iteration
     int ret = 0;
     std::list<struct _OutputRow*> outputRowsAdd;
+    std::vector<std::string> foundFiles = findFiles(fileSpec, Config);
 
-    try {
-       
-        std::list<struct _OutputTLC*> outputTLCsAdd;
-
-        if (Config->searchSubdirs) {
-            for (const auto& entry : fs::recursive_directory_iterator(Config->searchPath, dirOptions)) {
-
-                // Get the file or directory attributes
-                DWORD attributes = GetFileAttributesW(entry.path().c_str());
 
-                // Check if the entry is hidden or a system file, and skip it if so
-                if (attributes != INVALID_FILE_ATTRIBUTES && (attributes & (FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM))) {
-                    continue;  // Skip hidden or system files/directories
-                }
+    // With /j:N the data export is parsed up front on a pool of threads, one file per thread at a
+    // time. The rows are merged below in file order exactly as if they were parsed one by one
+    bool parallel = Config->dataMode == true && Config->jobs > 1 && foundFiles.size() > 1;
+    std::vector<int> parsedRets;
+    std::vector<std::list<struct _OutputRow*>> parsedRows;
 
-                if (entry.is_regular_file()) {
-                    if (std::regex_match(entry.path().filename().string(), std::regex(fileSpec))) {
-                        std::string foundFile = entry.path().string();
-                        std::cout << "Found: " << foundFile << std::endl;
-
-                        if (ret == 0 && Config->tlcMode == true)
-                            ret = ExtractEMObsFileTLCs(foundFile, outputFileTLCListStream, outputTLCsAdd);
-
-                        if (ret == 0 && Config->tlcHierarchyMode == true)
-                            ret = ExtractEMObsFileTLCsDisplayHierarchy(foundFile, outputFileTLCHierarchyStream);
-
-                        if (ret == 0 && Config->hexDumpMode == true)
-                            ret = HexDumpEMObsFile(foundFile, outputFileHexDumpStream);
+    if (parallel) {
+        std::cout << "Parsing " << foundFiles.size() << " files on " << Config->jobs << " threads" << std::endl;
+        ProcessEMObsFilesParallel(foundFiles, Config, parsedRets, parsedRows);
+    }
 
-                        if (ret == 0 && Config->dataMode == true) {
-                            // Open the EMObs file
-                            EMObsReader reader(foundFile);
+    // Each file is loaded once (read ahead of the parser) and shared by all the exports. With /j:N
+    // the data export is already parsed, the threads read their own
+    bool loadFiles = (Config->dataMode == true && !parallel) || Config->tlcMode == true || Config->tlcHierarchyMode == true ||
+        Config->hexDumpMode == true || Config->benchScanMode == true;
+    std::unique_ptr<FilePrefetch> prefetch;
+    if (loadFiles && Config->prefetch > 0 && foundFiles.size() > 1)
+        prefetch = std::make_unique<FilePrefetch>(foundFiles, Config->prefetch);
+
+    for (size_t i = 0; i < foundFiles.size(); i++) {
+        const std::string& foundFile = foundFiles[i];
+        std::cout << "Found: " << foundFile << std::endl;
+
+        if (ret != 0)
+            continue;
+
+        // Open the EMObs file (or use the prefetched copy). If it can't be opened each export
+        // reports the error as before
+        std::shared_ptr<EMObsFileSource> source;
+        if (loadFiles) {
+            source = prefetch != nullptr ? prefetch->Next() : nullptr;
+            if (source == nullptr)
+                source = EMObsOpenFileSource(foundFile);
+        }
 
-                            // Read the contains
-                            ret = reader.Process(outputRowsAdd);
-                        }
-                    }
-                }
-            }
+        // The TLC list and hierarchy (written in one pass over the file) and the hex dump run on
+        // their own threads alongside the data export
+        int retTLCs = 0;
+        int retHexDump = 0;
+        int retData = 0;
+        std::vector<std::thread> exports;
+
+        if (Config->tlcMode == true || Config->tlcHierarchyMode == true) {
+            exports.emplace_back([&]() {
+                retTLCs = ExtractEMObsFileTLCs(foundFile, source, Config->tlcMode ? &outputFileTLCListStream : nullptr,
+                    Config->tlcHierarchyMode ? &outputFileTLCHierarchyStream : nullptr);
+            });
         }
-        else {
-            for (const auto& entry : fs::directory_iterator(Config->searchPath, dirOptions)) {
 
-                // Get the file or directory attributes
-                DWORD attributes = GetFileAttributesW(entry.path().c_str());
+        if (Config->hexDumpMode == true) {
+            exports.emplace_back([&]() {
+                retHexDump = HexDumpEMObsFile(foundFile, source, outputFileHexDumpStream, Config->jobs);
+            });
+        }
 
-                // Check if the entry is hidden or a system file, and skip it if so
-                if (attributes != INVALID_FILE_ATTRIBUTES && (attributes & (FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM))) {
-                    continue;  // Skip hidden or system files/directories
-                }
+        if (Config->dataMode == true && parallel) {
+            // Number the rows on from the previous file
+            int rowBase = outputRowsAdd.empty() ? 0 : outputRowsAdd.back()->row;
+            for (struct _OutputRow* outputRow : parsedRows[i])
+                outputRow->row += rowBase;
 
-                if (entry.is_regular_file()) {
-                    if (std::regex_match(entry.path().filename().string(), std::regex(fileSpec))) {
-                        std::string foundFile = entry.path().string();
-                        std::cout << "Found: " << foundFile << std::endl;
+            outputRowsAdd.splice(outputRowsAdd.end(), parsedRows[i]);
+            retData = parsedRets[i];
+        }
+        else if (Config->dataMode == true) {
+            EMObsReader reader(foundFile, source);
+            reader.SetThreads(Config->jobs);
+            reader.SetDecodeMode(Config->decodeMode);
+            reader.SetCache(Config->cache, Config->cacheDirectory);
 
-                        if (ret == 0 && Config->tlcMode == true)
-                            ret = ExtractEMObsFileTLCs(foundFile, outputFileTLCListStream, outputTLCsAdd);
+            // Read the contains
+            retData = reader.Process(outputRowsAdd);
 
-                        if (ret == 0 && Config->tlcHierarchyMode == true)
-                            ret = ExtractEMObsFileTLCsDisplayHierarchy(foundFile, outputFileTLCHierarchyStream);
+            if (Config->benchScanMode == true)
+                ReportEMObsFileParseMemory(reader);
+        }
 
-                        if (ret == 0 && Config->hexDumpMode == true)
-                            ret = HexDumpEMObsFile(foundFile, outputFileHexDumpStream);
+        for (std::thread& thread : exports)
+            thread.join();
 
-                        if (ret == 0 && Config->dataMode == true) {
-                            // Open the EMObs file
-                            EMObsReader reader(foundFile);
+        // The benchmark runs on its own so the timing isn't disturbed by the other exports
+        int retBench = 0;
+        if (Config->benchScanMode == true)
+            retBench = BenchmarkEMObsFileTLCScan(foundFile, source);
 
-                            // Read the contains
-                            ret = reader.Process(outputRowsAdd);
-                        }
-                    }
-                }
-            }
+        // The first error in the order the exports used to run in
+        for (int retExport : { retTLCs, retHexDump, retBench, retData }) {
+            if (ret == 0)
+                ret = retExport;
         }
     }
-    catch (const fs::filesystem_error& e) {
-        std::cerr << "searchFiles() Filesystem error: " << e.what() << std::endl;
+
+    // Rows parsed for files after an error are not used
+    for (std::list<struct _OutputRow*>& rows : parsedRows) {
+        for (struct _OutputRow* outputRow : rows)
+            delete outputRow;
     }
 
 
     // Find all the .MP4 files within the same directory as the EMObs file
-	std::wstring wsearchPath = std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>>().from_bytes(Config->searchPath);
+	std::wstring wsearchPath = EMObsFromUTF8(EMObsPathToUTF8(fs::path(Config->searchPath)));
     FileFind fileFind;
+    if (Config->mediaIndex)
+        fileFind.SetIndex(Config->mediaIndexFileSpec);
 
     ret = fileFind.ScanFiles(wsearchPath);
 
+    if (ret == 0 && Config->mediaIndex)
+        std::cout << "Media index: " << fileFind.GetDirectoriesListed() << " directories listed, " << fileFind.GetDirectoriesReused() << " unchanged" << std::endl;
+
     if (ret == 0) {
         // Check for duplicate EMObs of the same name.  Often the data is delivered after the season with
         // EMOBs in the video directory and combined into a single EMObs directory. This needs to be resolved
@@ -584,51 +814,51 @@ void searchFiles(const std::string& fileSpec, struct _Config* Config, FileMappin
         }
     }
 
+    if (ret == 0 && arrowExport) {
+        ret = ExportArrowFile(Config->outputFileData, outputRowsAdd);
+
+        // Clear the list of output rows
+        for (struct _OutputRow* item : outputRowsAdd) {
+            delete item;
+        }
+        outputRowsAdd.clear();
+    }
+
     if (ret == 0) {
-        if (outputFileDataStream.is_open()) {
+        if (outputFileDataStream.IsOpen()) {
 
-            std::wstring rowToWrite;
+            TSVWriter writer(outputFileDataStream);
 
             for (struct _OutputRow* item : outputRowsAdd) {
-                std::wstring opCodeItem = ReplaceTabs(item->opCode);
-                std::wstring PeriodItem = ReplaceTabs(item->Period);
-                std::wstring FamilyItem = ReplaceTabs(item->Family);
-                std::wstring GenusItem = ReplaceTabs(item->Genus);
-                std::wstring SpeciesItem = ReplaceTabs(item->Species);
-
-                // Concatenate each field with a tab delimiter
-                std::wstringstream ss;
-                ss << item->row << L"\t";
-                ss << item->PathEMObs << L"\t";
-                ss << item->FileEMObs << L"\t";
-                ss << opCodeItem << L"\t";
-                ss << RowTypeToString(item->rowType) << L"\t";
-                ss << PeriodItem << L"\t";
-                ss << item->Path << L"\t";
-                ss << item->FileL << L"\t";
-				ss << item->FileLStatus << L"\t";
-                ss << item->FrameL << L"\t";
-                ss << item->PointLX1 << L"\t";
-                ss << item->PointLY1 << L"\t";
-                ss << item->PointLX2 << L"\t";
-                ss << item->PointLY2 << L"\t";
-                ss << item->FileR << L"\t";
-                ss << item->FileRStatus << L"\t";
-                ss << item->FrameR << L"\t";
-                ss << item->PointRX1 << L"\t";
-                ss << item->PointRY1 << L"\t";
-                ss << item->PointRX2 << L"\t";
-                ss << item->PointRY2 << L"\t";
-                ss << item->Length << L"\t";
-                ss << FamilyItem << L"\t";
-                ss << GenusItem << L"\t";
-                ss << SpeciesItem << L"\t";
-                ss << item->count;
-
-                // Write the row to the output file
-                rowToWrite = ss.str();
-                outputFileDataStream << rowToWrite << std::endl;
+                writer.Int(item->row);
+                writer.String(item->PathEMObs);
+                writer.String(item->FileEMObs);
+                writer.EscapedString(item->opCode);
+                writer.String(RowTypeToString(item->rowType));
+                writer.EscapedString(item->Period);
+                writer.String(item->Path);
+                writer.String(item->FileL);
+                writer.String(item->FileLStatus);
+                writer.Int(item->FrameL);
+                writer.Double(item->PointLX1);
+                writer.Double(item->PointLY1);
+                writer.Double(item->PointLX2);
+                writer.Double(item->PointLY2);
+                writer.String(item->FileR);
+                writer.String(item->FileRStatus);
+                writer.Int(item->FrameR);
+                writer.Double(item->PointRX1);
+                writer.Double(item->PointRY1);
+                writer.Double(item->PointRX2);
+                writer.Double(item->PointRY2);
+                writer.Double(item->Length);
+                writer.EscapedString(item->Family);
+                writer.EscapedString(item->Genus);
+                writer.EscapedString(item->Species);
+                writer.Int(item->count);
+                writer.EndRow();
             }
+            writer.Flush();
 
             // Clear the list of output rows
             for (struct _OutputRow* item : outputRowsAdd) {
@@ -639,34 +869,14 @@ void searchFiles(const std::string& fileSpec, struct _Config* Config, FileMappin
     }
 
 
-    if (outputFileDataStream.is_open()) 
-        outputFileDataStream.close();
-    if (outputFileTLCListStream.is_open())
-		outputFileTLCListStream.close();
-    if (outputFileTLCHierarchyStream.is_open())
-		outputFileTLCHierarchyStream.close();
-    if (outputFileHexDumpStream.is_open())
-		outputFileHexDumpStream.close();
+    outputFileDataStream.Close();
+    outputFileTLCListStream.Close();
+    outputFileTLCHierarchyStream.Close();
+    outputFileHexDumpStream.Close();
 }
 
 
 
-// Static function to replace tab characters with "<Tab>"
-std::wstring ReplaceTabs(const std::wstring& input) {
-    std::wstring output = input;  // Copy the input string to modify
-    std::wstring tabReplacement = L"<Tab>";  // Define the replacement string
-
-    size_t pos = 0;
-    // Find and replace all occurrences of tab characters
-    while ((pos = output.find(L'\t', pos)) != std::wstring::npos) {
-        output.replace(pos, 1, tabReplacement);  // Replace '\t' with "<Tab>"
-        pos += tabReplacement.length();  // Move past the replacement
-    }
-
-    return output;  // Return the modified string
-}
-
-
 // Function to convert RowType to a string representation
 std::wstring RowTypeToString(RowType type) {
     switch (type) {
@@ -684,121 +894,112 @@ std::wstring RowTypeToString(RowType type) {
 }
 
 
-int ExtractEMObsFileTLCs(const std::string foundFile, std::wofstream& outputFileStream, std::list<struct _OutputTLC*>& outputTLCsAdd) {
-    
-    int ret = 0;
+/// <summary>
+/// Writes the /t TLC list rows and the /th TLC hierarchy of a file as EMObsReader::ScanTLCs() finds
+/// each TLC. Either stream can be nullptr
+/// </summary>
+class TLCExportVisitor : public EMObsTLCVisitor {
+public:
+    TLCExportVisitor(const std::string& _foundFile, EMObsUTF8Writer* outputFileTLCListStream, EMObsUTF8Writer* _outputFileTLCHierarchyStream)
+        : foundFile(_foundFile), outputFileTLCHierarchyStream(_outputFileTLCHierarchyStream) {
 
-    // Open the EMObs file
-    EMObsReader reader(foundFile);
+        if (outputFileTLCListStream != nullptr && outputFileTLCListStream->IsOpen()) {
+            listWriter = std::make_unique<TSVWriter>(*outputFileTLCListStream);
 
-    // Read the contains
-    ret = reader.ExtractTLCs(outputTLCsAdd);
+            fs::path fullPath(foundFile);
+            path = fullPath.parent_path().wstring();
+            file = fullPath.filename().wstring();
+        }
 
-    if (ret == 0) {
-        if (outputFileStream.is_open()) {
-
-            std::wstring rowToWrite;
-
-            for (struct _OutputTLC* item : outputTLCsAdd) {
-
-                // Concatenate each field with a tab delimiter
-                std::wstringstream ss;
-                ss << item->row << L"\t";
-                ss << item->Path << L"\t";
-                ss << item->File1 << L"\t"; 
-                ss << std::setfill(L'0') << std::setw(8) << std::hex << std::uppercase << item->seekOffset << L"\t";
-                ss << item->tlc << L"\t";
-                ss << (int)item->cTLCByte << L"\t";
-                ss << item->data1 << L"\t";
-                ss << item->data2 << L"\t";
-                ss << item->data3 << L"\t";
-
-                // Write the row to the output file
-                outputFileStream << ss.str() << std::endl;
-            }
+        if (outputFileTLCHierarchyStream != nullptr && !outputFileTLCHierarchyStream->IsOpen())
+            outputFileTLCHierarchyStream = nullptr;
+    }
 
-            // Clear the list of output rows
-            for (struct _OutputTLC* item : outputTLCsAdd) {
-                delete item;
+    bool onTLC(const EMObsTLCItem& item) override {
+
+        if (listWriter != nullptr) {
+            listWriter->Int(item.row);
+            listWriter->String(path);
+            listWriter->String(file);
+            listWriter->Hex((unsigned long)item.seekOffset, 8);
+            listWriter->String(item.cTLC, 3);
+            listWriter->Int(item.cTLCVersion);
+            if (item.hasFrame) {
+                listWriter->Int(item.iCameraZeroLeftOneRight);
+                listWriter->Int(item.iFrameIndex);
+            }
+            else {
+                listWriter->String("", 0);
+                listWriter->String("", 0);
             }
-            outputTLCsAdd.clear();
+            listWriter->String("", 0);      // data3
+            listWriter->String("", 0);      // The rows end with a tab
+            listWriter->EndRow();
         }
-    }
-
-    return ret;
-}
-
-
-int ExtractEMObsFileTLCsDisplayHierarchy(const std::string foundFile, std::wofstream& outputFileStream) {
-
-    int ret = 0;
-
-    std::list<struct _OutputTLC*>outputTLCsAdd;
-
-    // Open the EMObs file
-    EMObsReader reader(foundFile);
-
-    // Read the contains
-    ret = reader.ExtractTLCs(outputTLCsAdd);
-
-    if (ret == 0) {
-        if (outputFileStream.is_open()) {
-
-            // Convert std::string to std::wstring
-            std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
-            std::wstring wfileSpec = converter.from_bytes(foundFile);
-            outputFileStream << std::endl << wfileSpec << std::endl;
-
 
-			int currentLevel = 0;
-            std::wstring rowToWrite;
-            std::wstringstream ss;
-            std::wstring indent;
-
-            for (struct _OutputTLC* item : outputTLCsAdd) {
-
-                if (item->tlc == L"EBS" || item->tlc == L"IDA" || item->tlc == L"CCC" || item->tlc == L"CMS" || item->tlc == L"PER") {
-                    currentLevel = 1;
+        if (outputFileTLCHierarchyStream != nullptr) {
+            WriteHierarchyHeader();
+
+            char text[32];
+            switch (EMObsTLC(item.cTLC)) {
+            case EMObsTLC("EBS"):
+            case EMObsTLC("IDA"):
+            case EMObsTLC("CCC"):
+            case EMObsTLC("CMS"):
+            case EMObsTLC("PER"):
+                // Top level, on a new line with the offset
+                snprintf(text, sizeof(text), "%s%08lX   ", EMObsTLC(item.cTLC) == EMObsTLC("EBS") ? "" : "\n", (unsigned long)item.seekOffset);
+                *outputFileTLCHierarchyStream << text;
+                break;
 
-                    if (item->tlc != L"EBS")
-                        ss << L"\n";
+            case EMObsTLC("PDA"):
+            case EMObsTLC("PDL"):
+            case EMObsTLC("PD3"):
+                // The points, each on its own line under the IDA
+                *outputFileTLCHierarchyStream << "\n                  ";
+                break;
+            }
 
-                    std::wstring spaces(3, L' ');  // 10 spaces
-                    indent = spaces;
+            snprintf(text, sizeof(text), "%.3s%d>", item.cTLC, (int)item.cTLCVersion);
+            *outputFileTLCHierarchyStream << text;
+        }
 
+        return true;
+    }
 
-                    // Format the number as hexadecimal, with padding of zeros, 8 digits long
-                    ss << std::setfill(L'0') << std::setw(8) << std::hex << std::uppercase << item->seekOffset << indent;
+    // The hierarchy starts with the file spec, even if there are no TLCs
+    void WriteHierarchyHeader() {
+        if (outputFileTLCHierarchyStream != nullptr && !hierarchyStarted) {
+            *outputFileTLCHierarchyStream << "\n" << EMObsPathToUTF8(fs::path(foundFile)) << "\n";
+            hierarchyStarted = true;
+        }
+    }
 
-                }
-                else if (item->tlc == L"PDA" || item->tlc == L"PDL" || item->tlc == L"PD3") {
-                    currentLevel = 2;
+private:
+    const std::string& foundFile;
+    std::unique_ptr<TSVWriter> listWriter;
+    std::wstring path;
+    std::wstring file;
+    EMObsUTF8Writer* outputFileTLCHierarchyStream;
+    bool hierarchyStarted = false;
+};
 
-                    std::wstring spaces(18, L' ');  // 10 spaces
-                    indent = spaces;
-                    ss << std::endl << indent;
-                }
-               
-                ss << item->tlc << (int)item->cTLCByte << ">";
-            }
 
-            // Write the row to the output file
-            outputFileStream << ss.str();
+int ExtractEMObsFileTLCs(const std::string foundFile, std::shared_ptr<EMObsFileSource> source, EMObsUTF8Writer* outputFileTLCListStream, EMObsUTF8Writer* outputFileTLCHierarchyStream) {
 
+    // Open the EMObs file (or use the already loaded source)
+    EMObsReader reader(foundFile, source);
 
-            // Clear the list of output rows
-            for (struct _OutputTLC* item : outputTLCsAdd) {
-                delete item;
-            }
-            outputTLCsAdd.clear();
+    TLCExportVisitor visitor(foundFile, outputFileTLCListStream, outputFileTLCHierarchyStream);
 
-            ss << std::endl;
-        }
-    }
+    int ret = reader.ScanTLCs(visitor);
+    if (ret == 0)
+        visitor.WriteHierarchyHeader();
 
     return ret;
 }
 
+
 /*
 Seem TLC and TLC counts From Utila 2023
 CAM	110
@@ -819,28 +1020,219 @@ PER	55
 PTN	55*/
 
 
-int HexDumpEMObsFile(const std::string foundFile, std::wofstream& outputFileStream) {
+int HexDumpEMObsFile(const std::string foundFile, std::shared_ptr<EMObsFileSource> source, EMObsUTF8Writer& outputFileStream, unsigned int threads) {
 
     int ret = 0;
 
-    // Open the EMObs file
-    EMObsReader reader(foundFile);
+    // Open the EMObs file (or use the already loaded source)
+    EMObsReader reader(foundFile, source);
 
-    if (outputFileStream.is_open()) {
+    if (outputFileStream.IsOpen()) {
         // Get the file size
         std::filesystem::path path(foundFile);
-        uintmax_t fileSize = std::filesystem::file_size(path);
+        std::error_code error;
+        uintmax_t fileSize = source != nullptr ? source->GetSize() : std::filesystem::file_size(path, error);
+        if (error) {
+            std::cerr << "Error: Unable to open the file for the hex dump: " << foundFile << " - " << error.message() << std::endl;
+            return -1;
+        }
 		uintmax_t pages = fileSize / (48*16);
 
 
-        // Convert std::string to std::wstring
-        std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
-        std::wstring wfileSpec = converter.from_bytes(foundFile);
-        outputFileStream << std::endl << wfileSpec << L"  Size: " << fileSize << " bytes  Pages:" << pages << std::endl;
+        outputFileStream << "\n" << EMObsPathToUTF8(path) << "  Size: " << std::to_string(fileSize) << " bytes  Pages:" << std::to_string(pages) << "\n";
 
-        reader.HexDumpToFile(outputFileStream, 16/*row width*/, 48/*row per page*/);
+        // Formatted on the /j:N threads
+        reader.SetThreads(threads);
+        ret = reader.HexDumpToFile(outputFileStream, 16/*row width*/, 48/*row per page*/);
     }
 
 
     return ret;
 }
+
+
+/// <summary>
+/// Time each supported TLC scanner over the whole file and report the throughput. The count of TLC
+/// candidates found must be the same for every scanner
+/// </summary>
+int BenchmarkEMObsFileTLCScan(const std::string foundFile, std::shared_ptr<EMObsFileSource> source) {
+
+    if (source == nullptr)
+        source = EMObsOpenFileSource(foundFile);
+    if (source == nullptr)
+        return -1;
+
+    const unsigned char* buffer = source->GetData();
+    size_t size = source->GetSize();
+
+    for (TLCScanMode mode : { TLCScanMode::Scalar, TLCScanMode::SSE2, TLCScanMode::AVX2 }) {
+
+        if (!TLCScanIsSupported(mode))
+            continue;
+
+        long count = 0;
+        int repeats = 0;
+        double seconds = 0;
+        auto start = std::chrono::steady_clock::now();
+
+        // Repeat for at least 200ms to get a stable figure
+        do {
+            count = 0;
+            long pos = TLCScanFindNext(buffer, size, 0, mode);
+            while (pos != -1) {
+                count++;
+                pos = TLCScanFindNext(buffer, size, pos + 1, mode);
+            }
+
+            repeats++;
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        } while (seconds < 0.2);
+
+        double mbPerSecond = ((double)size * repeats) / (1024.0 * 1024.0) / seconds;
+
+        std::cout << "    " << std::left << std::setw(8) << TLCScanModeName(mode) << std::right
+            << " TLCs: " << count << "  " << std::fixed << std::setprecision(1) << mbPerSecond << " MB/s" << std::defaultfloat << std::endl;
+    }
+
+    return 0;
+}
+
+
+/// <summary>
+/// Report the parse tree allocations held by the reader's arena
+/// </summary>
+void ReportEMObsFileParseMemory(const EMObsReader& reader) {
+
+    const EMObsArenaStats& stats = reader.GetArenaStats();
+
+    std::cout << "    Parse tree: " << stats.allocations << " allocations, " << stats.bytesUsed / 1024 << " KB used, "
+        << stats.bytesReserved / 1024 << " KB in " << stats.blocks << " block(s), peak " << stats.peakBytesUsed / 1024 << " KB" << std::endl;
+}
+
+
+/// <summary>
+/// Parse the files on a pool of threads. Each file's rows are numbered from 1 and returned in
+/// rows[i] with the Process() result in rets[i]
+/// </summary>
+void ProcessEMObsFilesParallel(const std::vector<std::string>& foundFiles, const struct _Config* Config, std::vector<int>& rets, std::vector<std::list<struct _OutputRow*>>& rows) {
+
+    rets.assign(foundFiles.size(), 0);
+    rows.clear();
+    rows.resize(foundFiles.size());
+
+    ForEachEMObsFileParallel(foundFiles, Config->jobs, [&](unsigned int, size_t i, std::shared_ptr<EMObsFileSource> source) {
+        // The loader has already reported why the file could not be opened
+        if (source == nullptr) {
+            rets[i] = -1;
+            return;
+        }
+
+        EMObsReader reader(foundFiles[i], source);
+        reader.SetDisplay(false);
+        reader.SetDecodeMode(Config->decodeMode);
+        reader.SetCache(Config->cache, Config->cacheDirectory);
+
+        rets[i] = reader.Process(rows[i]);
+    });
+}
+
+
+/// <summary>
+/// Call process for each file on a pool of jobs threads (numbered 0 to jobs-1). One more thread
+/// loads the files in batches (with io_uring on Linux, see EMObsBatchLoader) and hands them to
+/// the pool as they are read, with at most a few files per thread loaded and waiting. source is
+/// nullptr if the file could not be loaded
+/// </summary>
+void ForEachEMObsFileParallel(const std::vector<std::string>& foundFiles, unsigned int jobs, const std::function<void(unsigned int thread, size_t i, std::shared_ptr<EMObsFileSource> source)>& process) {
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::pair<size_t, std::shared_ptr<EMObsFileSource>>> loaded;
+    size_t maxLoaded = (size_t)jobs * 4;
+    bool loadingDone = false;
+
+    std::thread loader([&]() {
+        EMObsBatchLoader batchLoader;
+
+        batchLoader.Load(foundFiles, [&](size_t i, std::shared_ptr<EMObsFileSource> source) {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&]() { return loaded.size() < maxLoaded; });
+            loaded.push_back({ i, source });
+            lock.unlock();
+            changed.notify_all();
+        });
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            loadingDone = true;
+        }
+        changed.notify_all();
+    });
+
+    auto worker = [&](unsigned int thread) {
+        while (true) {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&]() { return !loaded.empty() || loadingDone; });
+            if (loaded.empty())
+                break;
+
+            size_t i = loaded.front().first;
+            std::shared_ptr<EMObsFileSource> source = loaded.front().second;
+            loaded.pop_front();
+            lock.unlock();
+            changed.notify_all();
+
+            process(thread, i, source);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int t = 0; t < std::min<size_t>(jobs, foundFiles.size()); t++)
+        threads.emplace_back(worker, t);
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    loader.join();
+}
+
+
+/// <summary>
+/// Count the TLCs of all the files by TLC and version on the /j:N threads, each with its own
+/// counts, and write the merged table to the stats file
+/// </summary>
+int StatsEMObsFiles(const std::vector<std::string>& foundFiles, const struct _Config* Config) {
+
+    EMObsUTF8Writer outputFileStatsStream;
+    outputFileStatsStream.Open(Config->outputFileStats);
+    if (!outputFileStatsStream.IsOpen()) {
+        std::cerr << "Error: Unable to open output file for the EMObs TLC statistics: " << Config->outputFileStats << std::endl;
+        return -1;
+    }
+
+    std::cout << "Scanning " << foundFiles.size() << " files on " << Config->jobs << " thread(s)" << std::endl;
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<TLCStats> threadStats(std::max(1u, Config->jobs));
+    ForEachEMObsFileParallel(foundFiles, Config->jobs, [&](unsigned int thread, size_t, std::shared_ptr<EMObsFileSource> source) {
+        if (source != nullptr)
+            threadStats[thread].AddFile(source->GetData(), source->GetSize());
+        else
+            threadStats[thread].AddFailedFile();
+    });
+
+    TLCStats stats;
+    for (const TLCStats& statsThread : threadStats)
+        stats.Merge(statsThread);
+
+    stats.Write(outputFileStatsStream);
+    outputFileStatsStream.Close();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    stats.Report();
+    std::cout << "    " << std::fixed << std::setprecision(2) << seconds << " s" << std::defaultfloat << std::endl;
+
+    return 0;
+}
@@ -131,6 +131,7 @@ namespace EMObsReaderNameSpace
             // Native std::list to hold _OutputRow pointers
             std::list<struct _OutputRow*> outputRows;
 
+            reader->SetThreads(0);  // Decode large files on all the cores
             reader->Process(outputRows);  // Call C++ class method
 
             // Managed list to hold the converted output rows
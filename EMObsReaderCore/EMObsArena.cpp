@@ -0,0 +1,147 @@
+// EMObsArena.cpp : Monotonic allocator that owns the parse tree of one EMObs file.
+//
+
+#include "pch.h"
+#include "framework.h"
+
+#include "EMObsArena.h"
+
+
+EMObsArena::EMObsArena(size_t _blockSize) : blockSize(_blockSize) {
+}
+
+EMObsArena::~EMObsArena() {
+
+    Block* block = first;
+    while (block != nullptr) {
+        Block* next = block->next;
+        free(block);
+        block = next;
+    }
+}
+
+unsigned char* EMObsArena::BlockData(Block* block) {
+    return (unsigned char*)block + sizeof(Block);
+}
+
+EMObsArena::Block* EMObsArena::NewBlock(size_t minSize) {
+
+    size_t size = minSize > blockSize ? minSize : blockSize;
+
+    Block* block = (Block*)malloc(sizeof(Block) + size);
+    if (block == nullptr)
+        return nullptr;
+
+    block->next = nullptr;
+    block->size = size;
+    block->used = 0;
+
+    stats.blocks++;
+    stats.bytesReserved += size;
+
+    return block;
+}
+
+/// <summary>
+/// Bump allocate from the current block. If it is full move on to the next block (left over from
+/// a Rewind) or add a new block after the current one
+/// </summary>
+void* EMObsArena::Allocate(size_t size, size_t align) {
+
+    if (size == 0)
+        size = 1;
+
+    while (true) {
+        if (current != nullptr) {
+            uintptr_t base = (uintptr_t)BlockData(current);
+            uintptr_t p = (base + current->used + (align - 1)) & ~(uintptr_t)(align - 1);
+            size_t end = (size_t)(p - base) + size;
+
+            if (end <= current->size) {
+                stats.allocations++;
+                stats.bytesUsed += end - current->used;
+                if (stats.bytesUsed > stats.peakBytesUsed)
+                    stats.peakBytesUsed = stats.bytesUsed;
+
+                current->used = end;
+                return (void*)p;
+            }
+
+            // Reuse the next block if it is big enough
+            if (current->next != nullptr && current->next->size >= size + align) {
+                stats.bytesUsed += current->size - current->used;
+                current->used = current->size;
+                current = current->next;
+                current->used = 0;
+                continue;
+            }
+        }
+
+        Block* block = NewBlock(size + align);
+        if (block == nullptr)
+            return nullptr;
+
+        if (current == nullptr) {
+            block->next = first;
+            first = block;
+        }
+        else {
+            stats.bytesUsed += current->size - current->used;
+            current->used = current->size;
+            block->next = current->next;
+            current->next = block;
+        }
+        current = block;
+    }
+}
+
+EMObsArena::Mark EMObsArena::GetMark() const {
+
+    Mark mark;
+    mark.block = current;
+    mark.used = current != nullptr ? current->used : 0;
+    mark.allocations = stats.allocations;
+    mark.bytesUsed = stats.bytesUsed;
+
+    return mark;
+}
+
+void EMObsArena::Rewind(const Mark& mark) {
+
+    current = (Block*)mark.block;
+    if (current != nullptr)
+        current->used = mark.used;
+    else if (first != nullptr) {
+        // The mark was taken before anything was allocated
+        current = first;
+        current->used = 0;
+    }
+
+    stats.allocations = mark.allocations;
+    stats.bytesUsed = mark.bytesUsed;
+}
+
+void EMObsArena::Reset() {
+
+    if (first != nullptr) {
+        Block* block = first->next;
+        while (block != nullptr) {
+            Block* next = block->next;
+            stats.blocks--;
+            stats.bytesReserved -= block->size;
+            free(block);
+            block = next;
+        }
+
+        first->next = nullptr;
+        first->used = 0;
+    }
+
+    current = first;
+    stats.allocations = 0;
+    stats.bytesUsed = 0;
+}
+
+const EMObsArenaStats& EMObsArena::GetStats() const {
+    return stats;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+
+
+// Allocation counters for an EMObsArena
+struct EMObsArenaStats {
+    size_t allocations = 0;     // Objects and arrays allocated since the last Reset()
+    size_t bytesUsed = 0;       // Bytes handed out since the last Reset() (including alignment)
+    size_t bytesReserved = 0;   // Total size of the blocks currently held
+    size_t blocks = 0;          // Number of blocks currently held (each one is a single malloc)
+    size_t peakBytesUsed = 0;   // Highest bytesUsed over the life of the arena
+};
+
+
+/// <summary>
+/// Per-file monotonic (bump pointer) allocator for the EMObs parse tree. Objects are never freed
+/// individually, the whole tree is released in one go by Reset() or when the arena is destroyed.
+/// Only trivially destructible types can be allocated as no destructors are ever run.
+/// </summary>
+class EMObsArena {
+public:
+    EMObsArena(size_t _blockSize = 64 * 1024);
+    ~EMObsArena();
+
+    EMObsArena(const EMObsArena&) = delete;
+    EMObsArena& operator=(const EMObsArena&) = delete;
+
+    // Raw memory, nullptr if out of memory
+    void* Allocate(size_t size, size_t align);
+
+    // A value initialised T, nullptr if out of memory
+    template <typename T>
+    T* New() {
+        static_assert(std::is_trivially_destructible<T>::value, "EMObsArena never runs destructors");
+        void* p = Allocate(sizeof(T), alignof(T));
+        return p != nullptr ? new (p) T() : nullptr;
+    }
+
+    // count value initialised Ts, nullptr if out of memory or count is 0
+    template <typename T>
+    T* NewArray(size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "EMObsArena never runs destructors");
+        if (count == 0 || count > SIZE_MAX / sizeof(T))
+            return nullptr;
+        T* p = (T*)Allocate(sizeof(T) * count, alignof(T));
+        if (p != nullptr) {
+            for (size_t i = 0; i < count; i++)
+                new (&p[i]) T();
+        }
+        return p;
+    }
+
+    // Mark/Rewind give back everything allocated since the mark, e.g. for a temporary record
+    struct Mark {
+        void* block;
+        size_t used;
+        size_t allocations;
+        size_t bytesUsed;
+    };
+    Mark GetMark() const;
+    void Rewind(const Mark& mark);
+
+    // Release the whole parse tree. The first block is kept for the next file
+    void Reset();
+
+    const EMObsArenaStats& GetStats() const;
+
+private:
+    struct Block {
+        Block* next;
+        size_t size;        // Usable bytes after the header
+        size_t used;
+    };
+
+    Block* NewBlock(size_t minSize);
+    static unsigned char* BlockData(Block* block);
+
+    size_t blockSize;
+    Block* first = nullptr;
+    Block* current = nullptr;
+    EMObsArenaStats stats;
+};
+
+
+/// <summary>
+/// Fixed capacity array of T living in an EMObsArena. Used in place of std::list for the children
+/// of a record, the capacity comes from the count stored in the file
+/// </summary>
+template <typename T>
+struct EMObsArenaArray {
+    using value_type = T;
+
+    T* items = nullptr;
+    size_t count = 0;
+    size_t capacity = 0;
+
+    bool Init(EMObsArena& arena, size_t _capacity) {
+        items = arena.NewArray<T>(_capacity);
+        count = 0;
+        capacity = items != nullptr ? _capacity : 0;
+        return items != nullptr || _capacity == 0;
+    }
+
+    // false if the array is full
+    bool push_back(const T& item) {
+        if (count >= capacity)
+            return false;
+        items[count++] = item;
+        return true;
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T* begin() const { return items; }
+    T* end() const { return items + count; }
+};
@@ -0,0 +1,427 @@
+// EMObsBatchLoader.cpp : Loads many files at once, using io_uring on Linux.
+//
+
+#include "pch.h"
+#include "framework.h"
+
+#if defined(__linux__) && !defined(EMOBS_NO_IO_URING) && __has_include(<linux/io_uring.h>)
+#define BATCHLOADER_IO_URING
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+#include "EMObsBatchLoader.h"
+
+
+#ifdef BATCHLOADER_IO_URING
+
+// io_uring takes a 32 bit length, so bigger files are read in pieces
+static const size_t maxReadSize = (size_t)1 << 30;
+
+// The operation is kept in the bottom two bits of the user data, the file in the rest
+enum BatchOp {
+    BatchOpen = 0,
+    BatchStat = 1,
+    BatchRead = 2,
+    BatchClose = 3
+};
+
+static inline uint64_t BatchTag(size_t index, BatchOp op) {
+    return ((uint64_t)index << 2) | (uint64_t)op;
+}
+
+
+/// <summary>
+/// The submission and completion rings shared with the kernel, driven with the raw system calls
+/// so there is no dependency on liburing
+/// </summary>
+struct EMObsBatchLoader::Ring {
+    int fd = -1;
+    unsigned entries = 0;
+
+    void* sqRing = MAP_FAILED;
+    size_t sqRingSize = 0;
+    void* cqRing = MAP_FAILED;
+    size_t cqRingSize = 0;
+    struct io_uring_sqe* sqes = (struct io_uring_sqe*)MAP_FAILED;
+    size_t sqesSize = 0;
+
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqMask = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned sqeTail = 0;           // Queued entries not yet passed to the kernel end here
+
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned* cqMask = nullptr;
+    struct io_uring_cqe* cqes = nullptr;
+
+    ~Ring() {
+        if (sqes != MAP_FAILED)
+            munmap(sqes, sqesSize);
+        if (cqRing != MAP_FAILED && cqRing != sqRing)
+            munmap(cqRing, cqRingSize);
+        if (sqRing != MAP_FAILED)
+            munmap(sqRing, sqRingSize);
+        if (fd >= 0)
+            close(fd);
+    }
+
+    bool Setup(unsigned _entries) {
+
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+
+        fd = (int)syscall(__NR_io_uring_setup, _entries, &params);
+        if (fd < 0)
+            return false;
+
+        entries = params.sq_entries;
+
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+        bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMap)
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+        sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED)
+            return false;
+
+        if (singleMap)
+            cqRing = sqRing;
+        else {
+            cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            if (cqRing == MAP_FAILED)
+                return false;
+        }
+
+        sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+        sqes = (struct io_uring_sqe*)mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED)
+            return false;
+
+        unsigned char* sq = (unsigned char*)sqRing;
+        sqHead = (unsigned*)(sq + params.sq_off.head);
+        sqTail = (unsigned*)(sq + params.sq_off.tail);
+        sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+        sqArray = (unsigned*)(sq + params.sq_off.array);
+        sqeTail = *sqTail;
+
+        unsigned char* cq = (unsigned char*)cqRing;
+        cqHead = (unsigned*)(cq + params.cq_off.head);
+        cqTail = (unsigned*)(cq + params.cq_off.tail);
+        cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+        cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+        return true;
+    }
+
+    // A cleared entry to fill in, nullptr if the submission ring is full
+    struct io_uring_sqe* GetSQE() {
+
+        unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        if (sqeTail - head >= entries)
+            return nullptr;
+
+        unsigned index = sqeTail & *sqMask;
+        struct io_uring_sqe* sqe = &sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqArray[index] = index;
+        sqeTail++;
+
+        return sqe;
+    }
+
+    // Pass the queued entries to the kernel and optionally wait for completions
+    int Submit(unsigned waitFor) {
+
+        __atomic_store_n(sqTail, sqeTail, __ATOMIC_RELEASE);
+
+        while (true) {
+            unsigned toSubmit = sqeTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+            int ret = (int)syscall(__NR_io_uring_enter, fd, toSubmit, waitFor, waitFor > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            if (ret >= 0 || errno != EINTR)
+                return ret;
+        }
+    }
+
+    // Take the next completion, waiting for it if need be
+    bool WaitCQE(struct io_uring_cqe* cqe) {
+
+        while (true) {
+            unsigned head = *cqHead;
+            if (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+                *cqe = cqes[head & *cqMask];
+                __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+
+            if (Submit(1) < 0)
+                return false;
+        }
+    }
+};
+
+
+// State of one file in a batch
+struct BatchFile {
+    int fd = -1;
+    struct statx stx;
+    unsigned char* buffer = nullptr;
+    size_t size = 0;
+    size_t done = 0;
+    bool failed = false;
+    bool reading = false;       // A read into buffer is queued
+};
+
+static void QueueRead(struct io_uring_sqe* sqe, size_t index, BatchFile& file) {
+
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = file.fd;
+    sqe->addr = (uint64_t)(uintptr_t)(file.buffer + file.done);
+    sqe->len = (uint32_t)std::min(file.size - file.done, maxReadSize);
+    sqe->off = (uint64_t)file.done;
+    sqe->user_data = BatchTag(index, BatchRead);
+}
+
+
+/// <summary>
+/// Give up on a batch when the ring fails. The files already opened are closed and the buffers
+/// freed, except a buffer with a read still queued which the kernel may yet write to, so it is
+/// left allocated
+/// </summary>
+static void AbandonBatch(std::vector<BatchFile>& batch) {
+
+    for (BatchFile& file : batch) {
+        if (file.fd >= 0)
+            close(file.fd);
+        if (!file.reading)
+            free(file.buffer);
+        file.fd = -1;
+        file.buffer = nullptr;
+    }
+}
+
+
+/// <summary>
+/// Open, size, read and close every file of the batch with io_uring. Each step is queued for the
+/// whole batch and submitted together. A file that fails in any step is passed to
+/// EMObsOpenFileSource() instead, so the errors are reported as usual
+/// </summary>
+/// <returns>0 if ok, -1 if the ring failed (nothing has been passed to onLoaded and the files
+/// opened have been closed)</returns>
+int EMObsBatchLoader::LoadBatch(const std::vector<std::string>& files, size_t first, size_t count, const LoadedCallback& onLoaded) {
+
+    std::vector<BatchFile> batch(count);
+    unsigned outstanding = 0;
+    struct io_uring_cqe cqe;
+
+    // Open and size
+    for (size_t i = 0; i < count; i++) {
+        const char* path = files[first + i].c_str();
+
+        // The ring has room for the whole batch, if not the file is opened the usual way
+        struct io_uring_sqe* sqe = ring->GetSQE();
+        if (sqe == nullptr) {
+            batch[i].failed = true;
+            continue;
+        }
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uint64_t)(uintptr_t)path;
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        sqe->user_data = BatchTag(i, BatchOpen);
+        outstanding++;
+
+        sqe = ring->GetSQE();
+        if (sqe == nullptr) {
+            batch[i].failed = true;     // The file is closed with the rest once it is open
+            continue;
+        }
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uint64_t)(uintptr_t)path;
+        sqe->len = STATX_SIZE;
+        sqe->off = (uint64_t)(uintptr_t)&batch[i].stx;
+        sqe->user_data = BatchTag(i, BatchStat);
+        outstanding++;
+    }
+
+    while (outstanding > 0) {
+        if (!ring->WaitCQE(&cqe)) {
+            AbandonBatch(batch);
+            return -1;
+        }
+        outstanding--;
+
+        BatchFile& file = batch[cqe.user_data >> 2];
+        if ((cqe.user_data & 3) == BatchOpen) {
+            if (cqe.res >= 0)
+                file.fd = cqe.res;
+            else
+                file.failed = true;
+        }
+        else if (cqe.res == 0)
+            file.size = (size_t)file.stx.stx_size;
+        else
+            file.failed = true;
+    }
+
+    // Read
+    for (size_t i = 0; i < count; i++) {
+        BatchFile& file = batch[i];
+        if (file.failed || file.size == 0)
+            continue;
+
+        file.buffer = (unsigned char*)malloc(file.size);
+        if (file.buffer == nullptr) {
+            file.failed = true;
+            continue;
+        }
+
+        struct io_uring_sqe* sqe = ring->GetSQE();
+        if (sqe == nullptr) {
+            file.failed = true;
+            continue;
+        }
+        QueueRead(sqe, i, file);
+        file.reading = true;
+        outstanding++;
+    }
+
+    while (outstanding > 0) {
+        if (!ring->WaitCQE(&cqe)) {
+            AbandonBatch(batch);
+            return -1;
+        }
+        outstanding--;
+
+        size_t i = (size_t)(cqe.user_data >> 2);
+        BatchFile& file = batch[i];
+        file.reading = false;
+
+        if (cqe.res > 0) {
+            file.done += (size_t)cqe.res;
+
+            // Short read, ask for the rest
+            if (file.done < file.size) {
+                struct io_uring_sqe* sqe = ring->GetSQE();
+                if (sqe == nullptr) {
+                    file.failed = true;
+                    continue;
+                }
+                QueueRead(sqe, i, file);
+                file.reading = true;
+                outstanding++;
+            }
+        }
+        else if (cqe.res == 0)
+            file.size = file.done;      // The file got shorter
+        else
+            file.failed = true;
+    }
+
+    // Close
+    for (size_t i = 0; i < count; i++) {
+        if (batch[i].fd < 0)
+            continue;
+
+        struct io_uring_sqe* sqe = ring->GetSQE();
+        if (sqe == nullptr) {
+            close(batch[i].fd);
+            continue;
+        }
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = batch[i].fd;
+        sqe->user_data = BatchTag(i, BatchClose);
+        outstanding++;
+    }
+
+    while (outstanding > 0) {
+        if (!ring->WaitCQE(&cqe))
+            break;
+        outstanding--;
+
+        // Kernels without IORING_OP_CLOSE
+        if (cqe.res == -EINVAL)
+            close(batch[cqe.user_data >> 2].fd);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        BatchFile& file = batch[i];
+
+        if (file.failed) {
+            free(file.buffer);
+            onLoaded(first + i, EMObsOpenFileSource(files[first + i]));
+        }
+        else {
+            std::shared_ptr<EMObsBufferFile> source = std::make_shared<EMObsBufferFile>();
+            source->Adopt(file.buffer, file.done);
+            onLoaded(first + i, source);
+        }
+    }
+
+    return 0;
+}
+
+#else
+
+struct EMObsBatchLoader::Ring {
+};
+
+int EMObsBatchLoader::LoadBatch(const std::vector<std::string>& files, size_t first, size_t count, const LoadedCallback& onLoaded) {
+    return -1;
+}
+
+#endif
+
+
+EMObsBatchLoader::EMObsBatchLoader(unsigned int _batchSize) : batchSize(_batchSize > 0 ? _batchSize : 1) {
+
+#ifdef BATCHLOADER_IO_URING
+    // Room for the open and statx of every file in a batch
+    ring = new Ring();
+    if (!ring->Setup(batchSize * 2)) {
+        delete ring;
+        ring = nullptr;
+    }
+#endif
+}
+
+EMObsBatchLoader::~EMObsBatchLoader() {
+    delete ring;
+}
+
+bool EMObsBatchLoader::UsingIoUring() const {
+    return ring != nullptr;
+}
+
+int EMObsBatchLoader::Load(const std::vector<std::string>& files, const LoadedCallback& onLoaded) {
+
+    for (size_t first = 0; first < files.size(); first += batchSize) {
+        size_t count = std::min((size_t)batchSize, files.size() - first);
+
+        if (ring != nullptr) {
+            if (LoadBatch(files, first, count, onLoaded) == 0)
+                continue;
+
+            // The ring is broken, carry on without it
+            delete ring;
+            ring = nullptr;
+        }
+
+        for (size_t i = 0; i < count; i++)
+            onLoaded(first + i, EMObsOpenFileSource(files[first + i]));
+    }
+
+    return 0;
+}
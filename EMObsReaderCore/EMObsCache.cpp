@@ -0,0 +1,399 @@
+// EMObsCache.cpp : Sidecar cache of the decoded rows of an EMObs file.
+//
+
+#include "pch.h"
+#include "framework.h"
+
+#include <atomic>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <process.h>    // _getpid
+#define getpid _getpid
+#else
+#include <unistd.h>     // getpid
+#endif
+
+#include "EMObsCache.h"
+#include "EMObsReader.h"
+
+namespace fs = std::filesystem;
+
+
+// Bump when the layout or the decoded rows change, older sidecars are then rebuilt
+static const uint32_t cacheFormatVersion = 2;
+static const char cacheMagic[8] = { 'E', 'M', 'O', 'C', 'A', 'C', 'H', 'E' };
+
+// Sidecar layout, each part starts on an 8 byte boundary:
+//   _CacheHeader
+//   Full path of the EMObs file (UTF-8, pathBytes)
+//   _CacheRow[rowCount]
+//   String offsets uint32_t[stringCount + 1] (in UTF-16 code units)
+//   String data (UTF-16LE, stringUnits code units)
+struct _CacheHeader {
+    char magic[8];
+    uint32_t formatVersion;
+    uint32_t pathBytes;
+    uint64_t fileSize;
+    int64_t fileTime;
+    uint64_t fileHash;
+    int32_t decodeMode;     // EMObsDecodeMode the rows were decoded with
+    uint32_t reserved;      // 0
+    uint32_t rowCount;
+    uint32_t stringCount;
+    uint64_t stringUnits;
+};
+
+// An _OutputRow, the strings are indexes into the string table
+struct _CacheRow {
+    uint32_t opCode;
+    uint32_t Period;
+    uint32_t Path;
+    uint32_t FileL;
+    uint32_t FileR;
+    uint32_t Family;
+    uint32_t Genus;
+    uint32_t Species;
+    int32_t rowType;
+    int32_t FrameL;
+    int32_t FrameR;
+    int32_t count;
+    double PointLX1;
+    double PointLY1;
+    double PointLX2;
+    double PointLY2;
+    double PointRX1;
+    double PointRY1;
+    double PointRX2;
+    double PointRY2;
+};
+
+static inline size_t Align8(size_t n) {
+    return (n + 7) & ~(size_t)7;
+}
+
+
+/// <summary>
+/// The parts of the key that come from the file system
+/// </summary>
+static bool CacheFileKey(const std::string& filespec, std::string* path, int64_t* fileTime) {
+
+    std::error_code ec;
+
+    fs::path fullPath = fs::absolute(fs::path(filespec), ec);
+    if (ec)
+        return false;
+
+    fs::file_time_type writeTime = fs::last_write_time(fullPath, ec);
+    if (ec)
+        return false;
+
+    *path = EMObsPathToUTF8(fullPath);
+    *fileTime = (int64_t)writeTime.time_since_epoch().count();
+
+    return true;
+}
+
+static inline uint64_t HashRound(uint64_t acc, uint64_t input) {
+
+    const uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+    const uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+
+    acc += input * prime2;
+    acc = (acc << 31) | (acc >> 33);
+    return acc * prime1;
+}
+
+/// <summary>
+/// Four independent 64 bit lanes (in the style of xxHash64) so the multiplies of consecutive
+/// words overlap, then the lanes and the tail are mixed together
+/// </summary>
+uint64_t EMObsCacheHash(const unsigned char* data, size_t size) {
+
+    const uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+    const uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+    const uint64_t prime3 = 0x165667B19E3779F9ULL;
+
+    uint64_t lanes[4] = { prime1 + prime2, prime2, 0, 0 - prime1 };
+    size_t i = 0;
+
+    for (; i + 32 <= size; i += 32) {
+        for (int lane = 0; lane < 4; lane++) {
+            uint64_t word;
+            memcpy(&word, data + i + (size_t)lane * 8, sizeof(word));
+            lanes[lane] = HashRound(lanes[lane], word);
+        }
+    }
+
+    uint64_t hash = (uint64_t)size;
+    for (int lane = 0; lane < 4; lane++)
+        hash = HashRound(hash ^ HashRound(0, lanes[lane]), lanes[lane]) * prime1 + prime3;
+
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = HashRound(hash, word);
+    }
+    for (; i < size; i++)
+        hash = HashRound(hash, data[i]);
+
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    hash *= prime3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+
+std::string EMObsCachePath(const std::string& filespec, const std::string& cacheDirectory) {
+
+    if (cacheDirectory.empty())
+        return filespec + ".emocache";
+
+    std::error_code ec;
+    std::string fullPath = EMObsPathToUTF8(fs::absolute(fs::path(filespec), ec));
+    if (ec)
+        fullPath = filespec;
+
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llX", (unsigned long long)EMObsCacheHash((const unsigned char*)fullPath.data(), fullPath.size()));
+
+    fs::path path = fs::path(cacheDirectory) / fs::path(filespec).filename();
+    return path.string() + "." + hex + ".emocache";
+}
+
+
+int EMObsCacheLoad(const std::string& cachePath, const std::string& filespec, EMObsDecodeMode decodeMode,
+    const unsigned char* data, size_t size, int firstRow, std::list<struct _OutputRow*>& rows) {
+
+    EMObsMappedFile sidecar;
+    if (sidecar.Open(cachePath) != 0)
+        return -1;
+
+    const unsigned char* p = sidecar.GetData();
+    size_t sidecarSize = sidecar.GetSize();
+
+    // Check the key, the content hash last as it reads the whole file
+    struct _CacheHeader header;
+    if (p == nullptr || sidecarSize < sizeof(header))
+        return -2;
+    memcpy(&header, p, sizeof(header));
+
+    std::string path;
+    int64_t fileTime;
+    if (memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0 ||
+        header.formatVersion != cacheFormatVersion ||
+        header.decodeMode != (int32_t)decodeMode ||
+        header.fileSize != (uint64_t)size ||
+        !CacheFileKey(filespec, &path, &fileTime) ||
+        header.fileTime != fileTime ||
+        header.pathBytes != path.size())
+        return -2;
+
+    // Check the parts fit in the sidecar before touching them
+    size_t pathOffset = sizeof(header);
+    size_t rowsOffset = Align8(pathOffset + header.pathBytes);
+    size_t offsetsOffset = rowsOffset + (size_t)header.rowCount * sizeof(struct _CacheRow);
+    size_t stringsOffset = Align8(offsetsOffset + ((size_t)header.stringCount + 1) * sizeof(uint32_t));
+
+    if (stringsOffset > sidecarSize || header.stringUnits > (sidecarSize - stringsOffset) / sizeof(char16_t))
+        return -2;
+
+    if (memcmp(p + pathOffset, path.data(), path.size()) != 0 || header.fileHash != EMObsCacheHash(data, size))
+        return -2;
+
+    std::vector<uint32_t> offsets((size_t)header.stringCount + 1);
+    memcpy(offsets.data(), p + offsetsOffset, offsets.size() * sizeof(uint32_t));
+
+    // Strings are made on demand from views into the mapping, as they are from the EMObs file
+    auto text = [&](uint32_t index) {
+        EMObsWStringView view;
+        if (index < header.stringCount && offsets[index] <= offsets[index + 1] && offsets[index + 1] <= header.stringUnits) {
+            view.data = p + stringsOffset + (size_t)offsets[index] * sizeof(char16_t);
+            view.length = (int32_t)(offsets[index + 1] - offsets[index]);
+        }
+        return view.ToWString();
+    };
+
+    fs::path fullPath(filespec);
+    std::wstring PathEMObs = fullPath.parent_path().wstring();
+    std::wstring FileEMObs = fullPath.filename().wstring();
+
+    std::list<struct _OutputRow*> loaded;
+    int row = firstRow;
+
+    for (uint32_t i = 0; i < header.rowCount; i++) {
+        struct _CacheRow cacheRow;
+        memcpy(&cacheRow, p + rowsOffset + (size_t)i * sizeof(cacheRow), sizeof(cacheRow));
+
+        struct _OutputRow* outputRow = new struct _OutputRow();
+        outputRow->row = row++;
+        outputRow->PathEMObs = PathEMObs;
+        outputRow->FileEMObs = FileEMObs;
+        outputRow->opCode = text(cacheRow.opCode);
+        outputRow->rowType = (RowType)cacheRow.rowType;
+        outputRow->Period = text(cacheRow.Period);
+        outputRow->Path = text(cacheRow.Path);
+        outputRow->FileL = text(cacheRow.FileL);
+        outputRow->FrameL = cacheRow.FrameL;
+        outputRow->PointLX1 = cacheRow.PointLX1;
+        outputRow->PointLY1 = cacheRow.PointLY1;
+        outputRow->PointLX2 = cacheRow.PointLX2;
+        outputRow->PointLY2 = cacheRow.PointLY2;
+        outputRow->FileR = text(cacheRow.FileR);
+        outputRow->FrameR = cacheRow.FrameR;
+        outputRow->PointRX1 = cacheRow.PointRX1;
+        outputRow->PointRY1 = cacheRow.PointRY1;
+        outputRow->PointRX2 = cacheRow.PointRX2;
+        outputRow->PointRY2 = cacheRow.PointRY2;
+        outputRow->Family = text(cacheRow.Family);
+        outputRow->Genus = text(cacheRow.Genus);
+        outputRow->Species = text(cacheRow.Species);
+        outputRow->count = cacheRow.count;
+
+        loaded.push_back(outputRow);
+    }
+
+    rows.splice(rows.end(), loaded);
+
+    return 0;
+}
+
+
+/// <summary>
+/// Interns the row strings as UTF-16, each distinct string is stored once
+/// </summary>
+class CacheStringTable {
+public:
+    std::vector<uint32_t> offsets{ 0 };
+    std::vector<char16_t> units;
+
+    uint32_t Add(const std::wstring& s) {
+
+        auto found = index.find(s);
+        if (found != index.end())
+            return found->second;
+
+#if WCHAR_MAX <= 0xFFFF
+        units.insert(units.end(), s.begin(), s.end());
+#else
+        for (wchar_t c : s) {
+            if ((uint32_t)c >= 0x10000) {
+                units.push_back((char16_t)(0xD800 + (((uint32_t)c - 0x10000) >> 10)));
+                units.push_back((char16_t)(0xDC00 + (((uint32_t)c - 0x10000) & 0x3FF)));
+            }
+            else
+                units.push_back((char16_t)c);
+        }
+#endif
+
+        uint32_t ret = (uint32_t)offsets.size() - 1;
+        offsets.push_back((uint32_t)units.size());
+        index.emplace(s, ret);
+
+        return ret;
+    }
+
+private:
+    std::unordered_map<std::wstring, uint32_t> index;
+};
+
+int EMObsCacheSave(const std::string& cachePath, const std::string& filespec, EMObsDecodeMode decodeMode,
+    const unsigned char* data, size_t size, const std::list<struct _OutputRow*>& rows) {
+
+    struct _CacheHeader header{};
+    std::string path;
+
+    if (!CacheFileKey(filespec, &path, &header.fileTime))
+        return -1;
+
+    memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.formatVersion = cacheFormatVersion;
+    header.decodeMode = (int32_t)decodeMode;
+    header.pathBytes = (uint32_t)path.size();
+    header.fileSize = (uint64_t)size;
+    header.fileHash = EMObsCacheHash(data, size);
+    header.rowCount = (uint32_t)rows.size();
+
+    CacheStringTable strings;
+    std::vector<struct _CacheRow> cacheRows;
+    cacheRows.reserve(rows.size());
+
+    for (const struct _OutputRow* outputRow : rows) {
+        struct _CacheRow cacheRow{};
+
+        cacheRow.opCode = strings.Add(outputRow->opCode);
+        cacheRow.Period = strings.Add(outputRow->Period);
+        cacheRow.Path = strings.Add(outputRow->Path);
+        cacheRow.FileL = strings.Add(outputRow->FileL);
+        cacheRow.FileR = strings.Add(outputRow->FileR);
+        cacheRow.Family = strings.Add(outputRow->Family);
+        cacheRow.Genus = strings.Add(outputRow->Genus);
+        cacheRow.Species = strings.Add(outputRow->Species);
+        cacheRow.rowType = (int32_t)outputRow->rowType;
+        cacheRow.FrameL = (int32_t)outputRow->FrameL;
+        cacheRow.FrameR = (int32_t)outputRow->FrameR;
+        cacheRow.count = outputRow->count;
+        cacheRow.PointLX1 = outputRow->PointLX1;
+        cacheRow.PointLY1 = outputRow->PointLY1;
+        cacheRow.PointLX2 = outputRow->PointLX2;
+        cacheRow.PointLY2 = outputRow->PointLY2;
+        cacheRow.PointRX1 = outputRow->PointRX1;
+        cacheRow.PointRY1 = outputRow->PointRY1;
+        cacheRow.PointRX2 = outputRow->PointRX2;
+        cacheRow.PointRY2 = outputRow->PointRY2;
+
+        cacheRows.push_back(cacheRow);
+    }
+
+    header.stringCount = (uint32_t)strings.offsets.size() - 1;
+    header.stringUnits = strings.units.size();
+
+    // Write to a temporary file and rename it over the sidecar, so a reader never sees half a file
+    std::error_code ec;
+    fs::path sidecarPath(cachePath);
+    if (sidecarPath.has_parent_path())
+        fs::create_directories(sidecarPath.parent_path(), ec);
+
+    // The temporary file is named for this process and write, so other processes or threads
+    // writing the same sidecar each have their own
+    static std::atomic<unsigned int> tempCounter{ 0 };
+    fs::path tempPath = sidecarPath;
+    tempPath += "." + std::to_string((long long)getpid()) + "." + std::to_string(tempCounter++) + ".tmp";
+
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return -1;
+
+        const char padding[8]{};
+        auto pad = [&]() {
+            std::streamoff pos = file.tellp();
+            file.write(padding, (std::streamsize)(Align8((size_t)pos) - (size_t)pos));
+        };
+
+        file.write((const char*)&header, sizeof(header));
+        file.write(path.data(), (std::streamsize)path.size());
+        pad();
+        file.write((const char*)cacheRows.data(), (std::streamsize)(cacheRows.size() * sizeof(struct _CacheRow)));
+        file.write((const char*)strings.offsets.data(), (std::streamsize)(strings.offsets.size() * sizeof(uint32_t)));
+        pad();
+        file.write((const char*)strings.units.data(), (std::streamsize)(strings.units.size() * sizeof(char16_t)));
+
+        if (!file) {
+            file.close();
+            fs::remove(tempPath, ec);
+            return -1;
+        }
+    }
+
+    fs::rename(tempPath, sidecarPath, ec);
+    if (ec) {
+        fs::remove(tempPath, ec);
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+
+
+enum class EMObsDecodeMode;
+
+
+/// <summary>
+/// Sidecar cache of the rows EMObsReader::Process() decoded from an EMObs file, so that reopening
+/// an unchanged file doesn't parse it again. The sidecar is one binary file: a header with the key
+/// (the full path, size, modification time and a hash of the contents of the EMObs file, and the
+/// decode mode, which gives different rows for a damaged file), the rows as fixed size records and
+/// a table of the distinct strings they refer to. It is read with a single mapping
+/// (EMObsMappedFile) and is ignored, and then rewritten, if any part of the key doesn't match.
+/// </summary>
+
+// Where the sidecar for filespec is kept. With no cache directory it sits next to the EMObs file
+// as <file>.emocache, otherwise it is <file>.<hash of the full path>.emocache in cacheDirectory
+std::string EMObsCachePath(const std::string& filespec, const std::string& cacheDirectory);
+
+// 64 bit hash of the file contents, part of the key
+uint64_t EMObsCacheHash(const unsigned char* data, size_t size);
+
+// Add the cached rows of filespec (whose contents are data/size), numbered on from firstRow, to
+// the end of rows
+// Returns 0 if ok, -1 if there is no sidecar, -2 if it is stale or damaged
+int EMObsCacheLoad(const std::string& cachePath, const std::string& filespec, EMObsDecodeMode decodeMode,
+    const unsigned char* data, size_t size, int firstRow, std::list<struct _OutputRow*>& rows);
+
+// Write (or replace) the sidecar. Returns 0 if ok
+int EMObsCacheSave(const std::string& cachePath, const std::string& filespec, EMObsDecodeMode decodeMode,
+    const unsigned char* data, size_t size, const std::list<struct _OutputRow*>& rows);
@@ -0,0 +1,209 @@
+// EMObsFileSource.cpp : Memory-mapped and buffered read-only views of an EMObs file.
+//
+
+#include "pch.h"
+#include "framework.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "EMObsFileSource.h"
+
+
+/// <summary>
+/// EMObsMappedFile
+/// </summary>
+EMObsMappedFile::EMObsMappedFile() {
+}
+
+EMObsMappedFile::~EMObsMappedFile() {
+    Close();
+}
+
+/// <summary>
+/// Map the whole file read only. The file and mapping handles are closed straight away, the view
+/// keeps the mapping alive until Close()
+/// </summary>
+/// <returns>0 if ok, -1 if the file can't be opened, -2 if it can't be mapped</returns>
+int EMObsMappedFile::Open(const std::string& fileSpec) {
+
+    Close();
+
+#ifdef _WIN32
+    std::filesystem::path path(fileSpec);
+
+    HANDLE fileHandle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return -1;
+
+    LARGE_INTEGER fileSize{};
+    if (!GetFileSizeEx(fileHandle, &fileSize)) {
+        CloseHandle(fileHandle);
+        return -1;
+    }
+
+    // An empty file can't be mapped, but it is still a valid (empty) source
+    if (fileSize.QuadPart == 0) {
+        CloseHandle(fileHandle);
+        return 0;
+    }
+
+    HANDLE mappingHandle = CreateFileMappingW(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(fileHandle);
+    if (mappingHandle == NULL)
+        return -2;
+
+    void* view = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mappingHandle);
+    if (view == NULL)
+        return -2;
+
+    data = (const unsigned char*)view;
+    size = (size_t)fileSize.QuadPart;
+#else
+    int fd = open(fileSpec.c_str(), O_RDONLY);
+    if (fd == -1)
+        return -1;
+
+    struct stat st {};
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    // An empty file can't be mapped, but it is still a valid (empty) source
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED)
+        return -2;
+
+    // The parser walks the file from start to end
+    madvise(view, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    data = (const unsigned char*)view;
+    size = (size_t)st.st_size;
+#endif
+
+    return 0;
+}
+
+void EMObsMappedFile::Close() {
+
+    if (data != nullptr) {
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+#else
+        munmap((void*)data, size);
+#endif
+    }
+
+    data = nullptr;
+    size = 0;
+}
+
+const unsigned char* EMObsMappedFile::GetData() const {
+    return data;
+}
+
+size_t EMObsMappedFile::GetSize() const {
+    return size;
+}
+
+
+/// <summary>
+/// EMObsBufferFile
+/// </summary>
+EMObsBufferFile::EMObsBufferFile() {
+}
+
+EMObsBufferFile::~EMObsBufferFile() {
+    free(buffer);
+}
+
+/// <summary>
+/// Read the entire file into a heap buffer of exactly the file size
+/// </summary>
+/// <returns>0 if ok, -1 if the file can't be opened or read</returns>
+int EMObsBufferFile::Read(const std::string& fileSpec) {
+
+    free(buffer);
+    buffer = nullptr;
+    size = 0;
+
+    std::ifstream file(fileSpec, std::ifstream::binary | std::ifstream::ate);
+    if (!file) {
+        std::cerr << "Could not open the file '" << fileSpec << "'" << std::endl;
+        return -1;
+    }
+
+    std::streamoff fileSize = file.tellg();
+    if (fileSize <= 0)
+        return fileSize == 0 ? 0 : -1;
+
+    buffer = (unsigned char*)malloc((size_t)fileSize);
+    if (buffer == nullptr)
+        return -1;
+
+    file.seekg(0, std::ios::beg);
+    file.read(reinterpret_cast<char*>(buffer), fileSize);
+
+    if (!file) {
+        std::cerr << "Error occurred while reading the file" << std::endl;
+        free(buffer);
+        buffer = nullptr;
+        return -1;
+    }
+
+    size = (size_t)fileSize;
+    return 0;
+}
+
+void EMObsBufferFile::Adopt(unsigned char* _buffer, size_t _size) {
+
+    free(buffer);
+    buffer = _buffer;
+    size = _buffer != nullptr ? _size : 0;
+}
+
+const unsigned char* EMObsBufferFile::GetData() const {
+    return buffer;
+}
+
+size_t EMObsBufferFile::GetSize() const {
+    return size;
+}
+
+
+std::shared_ptr<EMObsFileSource> EMObsOpenFileSource(const std::string& fileSpec) {
+
+    std::shared_ptr<EMObsMappedFile> mappedFile = std::make_shared<EMObsMappedFile>();
+
+    int ret = mappedFile->Open(fileSpec);
+    if (ret == 0)
+        return mappedFile;
+
+    if (ret == -1) {
+        std::cerr << "Could not open the file '" << fileSpec << "'" << std::endl;
+        return nullptr;
+    }
+
+    // The file exists but can't be mapped, so read it instead
+    std::shared_ptr<EMObsBufferFile> bufferFile = std::make_shared<EMObsBufferFile>();
+    if (bufferFile->Read(fileSpec) == 0)
+        return bufferFile;
+
+    return nullptr;
+}
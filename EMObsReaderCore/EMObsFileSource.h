@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+
+/// <summary>
+/// Read-only view of the bytes of an EMObs file. The EMObsReaderBase cursor (GetNextAs*,
+/// GetFirstTLC/GetNextTLC etc) works directly on top of this span, so the file contents are
+/// never copied once they are loaded.
+/// </summary>
+class EMObsFileSource {
+public:
+    virtual ~EMObsFileSource() {}
+
+    virtual const unsigned char* GetData() const = 0;
+    virtual size_t GetSize() const = 0;
+};
+
+
+/// <summary>
+/// The file is memory-mapped read only (MapViewOfFile on Windows, mmap elsewhere). Pages are
+/// only touched when the parser reaches them and there is no heap copy of the file.
+/// </summary>
+class EMObsMappedFile : public EMObsFileSource {
+public:
+    EMObsMappedFile();
+    ~EMObsMappedFile();
+
+    int Open(const std::string& fileSpec);
+    void Close();
+
+    const unsigned char* GetData() const override;
+    size_t GetSize() const override;
+
+private:
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+};
+
+
+/// <summary>
+/// The file is read into a heap buffer. Used as the fallback when the file can't be mapped
+/// (e.g. some network shares).
+/// </summary>
+class EMObsBufferFile : public EMObsFileSource {
+public:
+    EMObsBufferFile();
+    ~EMObsBufferFile();
+
+    int Read(const std::string& fileSpec);
+
+    // Take over a buffer already read by the caller. It must come from malloc() and is freed with free()
+    void Adopt(unsigned char* _buffer, size_t _size);
+
+    const unsigned char* GetData() const override;
+    size_t GetSize() const override;
+
+private:
+    unsigned char* buffer = nullptr;
+    size_t size = 0;
+};
+
+
+// Open the file using a mapping if possible otherwise fallback to reading it into a buffer.
+// Returns nullptr if the file can't be opened
+std::shared_ptr<EMObsFileSource> EMObsOpenFileSource(const std::string& fileSpec);
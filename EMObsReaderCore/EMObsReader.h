@@ -1,5 +1,21 @@
 #pragma once
 
+#include <cstdarg>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "EMObsArena.h"
+#include "EMObsFileSource.h"
+#include "EMObsRecords.h"
+#include "EMObsSchema.h"
+#include "EMObsUTF8.h"
+#include "EMObsVisitor.h"
 
 // Output Structure
 enum RowType {
@@ -40,6 +56,39 @@ struct _OutputRow {
 };
 
 
+// A measurement row as views into the file buffer, the same fields as _OutputRow without making
+// any strings. Returned by the EMObsReader row cursor (NextRow/Rows) and only valid until the next
+// row is fetched from the same reader
+struct EMObsRowView {
+    int row = 0;                        // 1 based within the file
+    RowType rowType = None;
+    const struct _IDA* pIDA = nullptr;  // The IDA the row came from
+    EMObsWStringView opCode;
+    EMObsWStringView Period;
+    EMObsWStringView Path;
+    EMObsWStringView FileL;
+    long FrameL = 0;
+    double PointLX1 = 0.0;
+    double PointLY1 = 0.0;
+    double PointLX2 = 0.0;
+    double PointLY2 = 0.0;
+    EMObsWStringView FileR;
+    long FrameR = 0;
+    double PointRX1 = 0.0;
+    double PointRY1 = 0.0;
+    double PointRX2 = 0.0;
+    double PointRY2 = 0.0;
+    EMObsWStringView Family;
+    EMObsWStringView Genus;
+    EMObsWStringView Species;
+    int count = 0;
+    bool countError = false;            // The count column is not a number (count is -1)
+
+    // Copy into an _OutputRow (all fields except row, PathEMObs and FileEMObs)
+    void ToOutputRow(struct _OutputRow* outputRow) const;
+};
+
+
 struct _OutputTLC {
     int row;
     std::wstring Path;
@@ -53,11 +102,28 @@ struct _OutputTLC {
 };
 
 
+// Entry in the TLC index built by EMObsReaderBase::BuildTLCIndex()
+struct _TLCIndexEntry {
+    uint32_t offset;        // Seek offset of the TLC
+    uint32_t length;        // Bytes from the TLC to the next TLC (or the end of the file)
+    char cTLC[3];
+    char cTLCVersion;       // The byte after the TLC
+};
+
+
+// How EMObsReader finds the records in the file
+enum class EMObsDecodeMode {
+    Grammar,    // Follow the record grammar (EBS, IDA..., CMS/PER/CCC), scan only after an error
+    Scan        // Scan for the next TLC after each record
+};
+
+
 class EMObsReaderBase {
 
 private:
     std::string& filespec;
-    unsigned char* readBuffer;
+    std::shared_ptr<EMObsFileSource> source;
+    const unsigned char* readBuffer = nullptr;
     size_t readBufferSize = 0;
 
     // GetNext type current pointer
@@ -65,6 +131,13 @@ private:
     long readPointer = 0;
     long lastTLCSeekPointer = 0;
 
+    // Sticky, set when a read would go past the end of the buffer
+    bool readError = false;
+
+    // Offsets of all the TLCs in the file, built on first use
+    std::vector<struct _TLCIndexEntry> tlcIndex;
+    bool tlcIndexBuilt = false;
+
     // FindFirst/Next wstring
     unsigned char* p = nullptr;
     int size = 0;
@@ -75,16 +148,46 @@ public:
     EMObsReaderBase(std::string& _fileSpec);
     ~EMObsReaderBase();
 
-    // Open, read and close the file
+    // Open the file (memory-mapped) or use the source set by SetSource()
     int ReadFile();
+    void SetSource(std::shared_ptr<EMObsFileSource> _source);
+    std::shared_ptr<EMObsFileSource> GetSource();
+    const unsigned char* GetBuffer();
     size_t GetSize();
 
 
+    // Bounds checking. Require(n) checks once (e.g. for the smallest size of a record version, see
+    // EMObsReader::DecodeFields) that n bytes are left, the Load functions after it read without
+    // checking. A failed check sets the sticky read error and moves the read pointer to the end, so
+    // every later read fails without touching the buffer. The GetNextAs functions check for themselves
+    bool Require(size_t n) {
+        if ((size_t)readPointer <= readBufferSize && n <= readBufferSize - (size_t)readPointer)
+            return true;
+        SetReadError();
+        return false;
+    }
+    template <typename T>
+    T Load() {
+        T value;
+        memcpy(&value, &readBuffer[readPointer], sizeof(T));
+        readPointer += (long)sizeof(T);
+        return value;
+    }
+    void Load(void* buffer, size_t n) {
+        memcpy(buffer, &readBuffer[readPointer], n);
+        readPointer += (long)n;
+    }
+    bool HasReadError() const { return readError; }
+    void ClearReadError() { readError = false; }
+
     // Get basic types
     int PeekNextTLC(char* TLC);
+    int GetTLCAtReadPointer(char* TLC);
+    long ResyncToNextTLC(char* TLC);
     //std::string GetNextAsString();
     long GetReadPointer();
     std::wstring GetNextAsWString();
+    EMObsWStringView GetNextAsWStringView();
     std::int64_t GetNextAsInt64();
     std::int32_t GetNextAsInt32();
     std::int16_t GetNextAsInt16();
@@ -93,7 +196,7 @@ public:
     double GetNextAsDouble();
 
     // complex types
-    std::vector<std::vector<std::wstring>> GetNextAsMAT();
+    EMObsMAT GetNextAsMAT(EMObsArena& arena);
 
     // Find any TLCs
     int GetFirstTLC(void** p, int* size, char* TLC);
@@ -102,6 +205,13 @@ public:
     void SetSeekPointerToReadPointer();
     void SetReadPointerToSeekPointer();
     void SetReadPointerToLastTLCSeekPointer();
+    void SetReadPointer(long pointer);
+
+    // TLC index
+    int BuildTLCIndex();
+    size_t GetTLCIndexCount();
+    const struct _TLCIndexEntry* GetTLCIndexEntry(size_t ordinal);
+    long FindTLCIndexByOffset(long offset);
 
     // Find any wstrings
     long FindFirstwstring(void* p, int size, int* wssize);
@@ -112,41 +222,175 @@ public:
 
 
 private:
-    static long getFileSize(const std::string& fileName);
-    static bool readFileIntoBuffer(const std::string& fileName, unsigned char* buffer, size_t bufferSize);
-
+    void SetReadError();
     long findNextTLC(long startPointer, char* TLC);
     bool IsTLC(long startPointer, char* TLC);
 
 };
 
+class EMObsRowRange;
+
 class EMObsReader {
 
 private:
     std::string filespec;
     EMObsReaderBase* reader;
+    EMObsArena arena;           // Owns the parse tree, reset at the start of each Parse()/OpenRows()
+    bool display = true;        // Process() prints the records to the console
+    unsigned int threads = 1;   // Threads Process() decodes the IDAs on (0 is one per core)
+    bool quiet = false;         // Don't print decode errors (Parse() workers)
+    EMObsDecodeMode decodeMode = EMObsDecodeMode::Grammar;
+    bool cache = false;         // Process() uses a sidecar cache of the rows, see EMObsCache.h
+    std::string cacheDirectory; // Where the sidecar is kept, next to the file if empty
+    int decodeMessages = 0;     // Decode errors and warnings reported
+
+    // Record walk shared by Parse() and the row cursor
+    enum WalkRecord {
+        WalkEnd,
+        WalkEBS,
+        WalkIDA
+    };
+    struct {
+        int ret = -1;                       // WalkFindNext() result
+        bool finished = true;
+        bool resync = false;                // The last record was bad, scan for the next one
+        unsigned char* p = nullptr;
+        int size = 0;
+        char TLC[4]{};
+        struct _EBS* pEBS = nullptr;        // Kept for the whole walk
+        struct _IDA* pIDA = nullptr;        // Released by the next WalkNext()
+        EMObsArena::Mark idaMark{};
+    } walk;
+
+    // Row cursor
+    struct {
+        int row = 0;
+        int stage = 0;                      // 0 PDA, 1 PDL, 2 PD3
+        size_t index = 0;
+        EMObsRowView view;
+    } rows;
 
 public:
     EMObsReader(const std::string& _filespec);
+    EMObsReader(const std::string& _filespec, std::shared_ptr<EMObsFileSource> source);
+    ~EMObsReader();
+
+    // Streaming decode, see EMObsVisitor
+    int Parse(EMObsVisitor& visitor);
+
+    // As above with the IDAs decoded on several threads (0 is one per core). The visitor is still
+    // called on the calling thread in file order, so the result is the same as Parse(visitor)
+    int Parse(EMObsVisitor& visitor, unsigned int _threads);
+
+    // Pull style decode, one measurement row at a time. NextRow() returns false at the end
+    int OpenRows();
+    bool NextRow(EMObsRowView* row);
+    EMObsRowRange Rows();
 
     int Process(std::list<struct _OutputRow*>& outputRowsAdd);
     int ExtractTLCs(std::list<struct _OutputTLC*>& outputTLCsAdd);
-    int HexDumpToFile(std::wofstream& outputFileStream, int rowWidth, int rowsPerPage);
+
+    // Streaming TLC scan, see EMObsTLCVisitor. ExtractTLCs() is the same scan into a list
+    int ScanTLCs(EMObsTLCVisitor& visitor);
+    int HexDumpToFile(EMObsUTF8Writer& outputFileStream, int rowWidth, int rowsPerPage);
+
+    // Turn the Process() console display of the records on or off (e.g. when files are processed
+    // on several threads)
+    void SetDisplay(bool _display);
+
+    // Number of threads Process() uses for a single file, see Parse(visitor, threads). Also the
+    // threads HexDumpToFile() formats the dump on
+    void SetThreads(unsigned int _threads);
+
+    // How the records are found (default Grammar). Parse() on several threads always uses the TLC
+    // index to split the IDAs between the threads
+    void SetDecodeMode(EMObsDecodeMode _decodeMode);
+
+    // Let Process() load the rows from a sidecar cache when the file hasn't changed, and write the
+    // sidecar when it has. The sidecar goes in _cacheDirectory or next to the file if that is empty
+    void SetCache(bool _cache, const std::string& _cacheDirectory = std::string());
+
+    // Release the parse tree
+    void Reset();
+    const EMObsArenaStats& GetArenaStats() const;
 
 private:
 
-    struct _EBS* GetEBS();
-    struct _CIN* GetCIN();
-    struct _PTN* GetPTN();
-    struct _IDA* GetIDA();
-    struct _FRA* GetFRA();
-    struct _PDA* GetPDA();
-    struct _PDL* GetPDL();
-    struct _PD3* GetPD3();
-    struct _CPT* GetCPT();
-    struct _CMS* GetCMS();
-    struct _PER* GetPER();
-    struct _CCC* GetCCC();
+    int WalkBegin();
+    int WalkFindNext();
+    int WalkResync();
+    WalkRecord WalkNext();
+    bool VisitIDA(EMObsVisitor& visitor, const struct _IDA& IDA);
+    bool ParseIDARun(EMObsVisitor& visitor, std::vector<std::unique_ptr<EMObsReader>>& workers, size_t* used);
+    void DecodeError(const char* format, ...);
+    void DecodeWarning(const char* format, ...);
+    void DecodeMessage(const char* format, va_list args);
+
+    // Record decoders generated from EMObsSchema
+    enum DecodeResult {
+        DecodeFailed,       // Wrong TLC, unknown version or a required field failed
+        DecodePartial,      // A required field failed after the TLC and version matched
+        DecodeOk
+    };
+    template <typename Record>
+    DecodeResult DecodeRecord(Record* pRecord);
+    template <typename Record>
+    Record* NewRecord();
+    template <typename Record, typename... Versions>
+    DecodeResult DecodeVersion(Record* pRecord, char version, EMObsVersions<Versions...>);
+    template <typename Record, char Version, typename... Fields, size_t... Index>
+    bool DecodeFields(Record* pRecord, EMObsVersion<Version, Fields...>, std::index_sequence<Index...>);
+    template <typename Record, typename Field, bool Fixed>
+    bool DecodeField(Record* pRecord);
+
+
+};
+
+
+/// <summary>
+/// Input iterator over the rows of an EMObsReader. Each increment decodes just enough of the file
+/// for the next row, so a caller can stop, skip or filter without decoding the rest. Satisfies
+/// std::input_iterator, a default constructed iterator is the end
+/// </summary>
+class EMObsRowIterator {
+public:
+    using iterator_category = std::input_iterator_tag;
+    using iterator_concept = std::input_iterator_tag;
+    using value_type = EMObsRowView;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const EMObsRowView*;
+    using reference = const EMObsRowView&;
 
+    EMObsRowIterator() {}
+    explicit EMObsRowIterator(EMObsReader* _reader) : reader(_reader) { ++(*this); }
 
+    reference operator*() const { return row; }
+    pointer operator->() const { return &row; }
+
+    EMObsRowIterator& operator++() {
+        if (reader != nullptr && !reader->NextRow(&row))
+            reader = nullptr;
+        return *this;
+    }
+    void operator++(int) { ++(*this); }
+
+    bool operator==(const EMObsRowIterator& other) const { return reader == other.reader; }
+    bool operator!=(const EMObsRowIterator& other) const { return reader != other.reader; }
+
+private:
+    EMObsReader* reader = nullptr;
+    EMObsRowView row;
+};
+
+
+// for (const EMObsRowView& row : reader.Rows()) ...  begin() (re)starts the decode
+class EMObsRowRange {
+public:
+    explicit EMObsRowRange(EMObsReader* _reader) : reader(_reader) {}
+
+    EMObsRowIterator begin() const { return reader->OpenRows() == 0 ? EMObsRowIterator(reader) : EMObsRowIterator(); }
+    EMObsRowIterator end() const { return EMObsRowIterator(); }
+
+private:
+    EMObsReader* reader;
 };
@@ -5,511 +5,863 @@
 #include "pch.h"
 #include "framework.h"
 
+#include <atomic>
+#include <cstdarg>
+#include <thread>
+
+#include "EMObsCache.h"
 #include "EMObsReader.h"
+#include "EMObsTLCScan.h"
 
 namespace fs = std::filesystem;
 
-//#pragma pack(push, 1) // Save the current alignment setting and set alignment to 1 byte
 
-// EBS and children
-struct _EBS {
-    long fileSeekPointer;
-    char cTLC[3];
-    char cTLCVersion;                   // Seen 4 and 5 but no cheange in the data
-    std::wstring wsPictureDirectory;
 
-    struct _CIN* pCIN;                  // Holds the opcode data
-    struct _PTN* pPTN;                  // Holds the input field titles
-};
-struct _CIN {   // Holds the opcode data
-    long fileSeekPointer;
-    char cTLC[3]{};
-    char cTLCVersion;
 
-    std::vector<std::vector<std::wstring>> matTitle;
-    std::vector<std::vector<std::wstring>> matValue;
-};
-struct _PTN {   // Holds the input field titles
-    long fileSeekPointer;
-    char cTLC[3];
-    char cTLCVersion;
-    std::vector<std::vector<std::wstring>> matCollectionHeadings;
-    int32_t iData1;	    // seen as 86  
-};
 
-// IDA and children
-// IDA is used to hold arrays of 3D Measurement Points (PDL), 3D Points (PD3) and Points (PDA)
-// The character after this TLC is always ASCII 0x05
-// This is a variable length structure 
-// If always starts with an FRA
-
-struct _IDA {
-    long fileSeekPointer;
-    char cTLC[3];
-    char cTLCVersion;
-
-    struct _FRA* pFRA;
-
-    // 2D Point Array
-    struct {
-        int32_t iPDACount;
-        std::list<struct _PDA*> PDAList;
-
-    } TypePDA;
-
-#pragma pack(push, 1)
-    union {
-        char bData[16];
-        int32_t ints[4];
-        double doubles[2];
-    } data1;
-#pragma pack(pop)
-    std::wstring wsPeriodName;
-
-    // 3D Measurement Point Array
-    struct {
-        int32_t iPDLCount;
-        std::list<struct _PDL*> PDLList;
-    } TypePDL;
-
-    // 3D Point Array
-    struct {
-        int32_t iPD3Count;
-        std::list<struct _PD3*> PD3List;
-    } TypePD3;
-
-#pragma pack(push, 1)
-    union {
-        char bData[16];
-        int32_t ints[4];
-    } data2;
-#pragma pack(pop)
-};
 
-// FRA is used to hold a left/right camera indicator, a frame number and a media file (MP4)
-// The character after this TLC is always ASCII 0x01
-// This is a variable length structure 
-struct _FRA {
-    long fileSeekPointer;
-    char cTLC[3];
-    char cTLCVersion;
-
-    int32_t iCameraZeroLeftOneRight;
-    int32_t iFrameIndex;
-    std::wstring wsMediaFile;
-};
 
-// PDA is used to hold a single 2D Point in a left or right camera frame
-// The character after this TLC is always ASCII 0x01
-// This is a variable length structure 
-// PDL is exclusively a child of IDA
-struct _PDA {       // Beleive to indicate a Point in a frame
-    long fileSeekPointer;
-    char cTLC[3];
-    char cTLCVersion;    // Seen 0 and 1, 1 has an additional 16 bytes of unknown data are the MAT
+static void hexDump(const char* desc, long seekOffset, void* data, int len);
+static void DisplayEBS(struct _EBS* pEBS);
+static void DisplayIDA(struct _IDA* pIDA);
+static void DisplayCMS(struct _CMS* pCMS);
+static void DisplayPER(struct _PER* pPER);
+static void DisplayCCC(struct _CCC* pCCC);
+static void DisplayPDA(const wchar_t* pIndent, struct _PDA* pPDA);
+static void DisplayPDL(const wchar_t* pIndent, struct _PDL* pPDL);
+static void ClearOutputRow(struct _OutputRow* outputRow);
 
-    struct _CPT* pCPT;
-    std::vector<std::vector<std::wstring>> matCollectionValues;
 
-    char bData[16];		 // Not used in verion 0
-};
+/// <summary>
+/// Capacity for an array of child records from the count stored in the file. A record is at least
+/// minSize bytes so a bad count is capped at the number of records that could fit in the rest of
+/// the file
+/// </summary>
+static size_t RecordCapacity(EMObsReaderBase* reader, int32_t count, size_t minSize) {
 
-// CPT is used to hold an X,Y position on a frame
-// The character after this TLC is always ASCII 0x00
-// This is a fixed length structure of 16 bytes (2x double)
-struct _CPT {
-    long fileSeekPointer;
-    char cTLC[3];
-    char cTLCVersion;
+    if (count <= 0)
+        return 0;
 
-    double X;
-    double Y;
-};
+    long readPointer = reader->GetReadPointer();
+    size_t remaining = (size_t)readPointer < reader->GetSize() ? reader->GetSize() - (size_t)readPointer : 0;
 
+    return std::min((size_t)count, remaining / minSize);
+}
 
-// PDL is used to hold a 3D measurement point i.e. 2x3D points in the left camera frame and 2x3D points in the right camera frame
-// The character after this TLC is always ASCII 0x01
-// This is a variable length structure 
-// PDL is exclusively a child of IDA
-struct _PDL {
-    long fileSeekPointer;
-    char cTLC[3];
-    char cTLCVersion;
-
-    int32_t iData1;	    // seen 2
-    struct _CPT* pCPT1;
-    struct _CPT* pCPT2;
-    int32_t iData2;	    // seen 2  
-    struct _CPT* pCPT3;
-    struct _CPT* pCPT4;
-    struct _FRA* pFRA;
-    std::vector<std::vector<std::wstring>> matCollectionValues;
-};
+EMObsReader::EMObsReader(const std::string& _filespec) : filespec(_filespec) {
+    this->reader = new EMObsReaderBase(filespec);
+}
 
-// PD3 is used to hold a single 3D Point in a left or right camera frame
-// The character after this TLC is always ASCII 0x00 (different to PDA and PDL)
-// This is a variable length structure 
-// PD3 is exclusively a child of IDA
-struct _PD3 {
-    long fileSeekPointer;
-    char cTLC[3];
-    char cTLCVersion;
-
-    struct _CPT* pCPT1;
-    struct _CPT* pCPT2;
-    struct _FRA* pFRA;
-    std::vector<std::vector<std::wstring>> matCollectionValues;
-};
+EMObsReader::EMObsReader(const std::string& _filespec, std::shared_ptr<EMObsFileSource> source) : filespec(_filespec) {
+    this->reader = new EMObsReaderBase(filespec);
+    this->reader->SetSource(source);
+}
 
+EMObsReader::~EMObsReader() {
+    delete this->reader;
+}
 
-// CMS and children
-struct _CMS {
-    long fileSeekPointer;
-    char cTLC[3];
-    char cTLCVersion;
+void EMObsReader::SetDisplay(bool _display) {
+    display = _display;
+}
 
-};
+void EMObsReader::SetThreads(unsigned int _threads) {
+    threads = _threads;
+}
 
-// PER and children
-struct _PER {
-    long fileSeekPointer;
-    char cTLC[3];
-    char cTLCVersion;
+void EMObsReader::SetDecodeMode(EMObsDecodeMode _decodeMode) {
+    decodeMode = _decodeMode;
+}
 
-};
+void EMObsReader::SetCache(bool _cache, const std::string& _cacheDirectory) {
+    cache = _cache;
+    cacheDirectory = _cacheDirectory;
+}
 
-// CCC and children
-struct _CCC {
-    long fileSeekPointer;
-    char cTLC[3];
-    char cTLCVersion;
+/// <summary>
+/// Report a problem found while decoding a record. Errors and warnings are both counted and,
+/// unless the reader is quiet (a Parse() worker), printed to the console
+/// </summary>
+void EMObsReader::DecodeError(const char* format, ...) {
 
-};
+    va_list args;
+    va_start(args, format);
+    DecodeMessage(format, args);
+    va_end(args);
+}
 
-//#pragma pack(pop) // Restore the previous alignment setting
+void EMObsReader::DecodeWarning(const char* format, ...) {
 
+    va_list args;
+    va_start(args, format);
+    DecodeMessage(format, args);
+    va_end(args);
+}
 
+void EMObsReader::DecodeMessage(const char* format, va_list args) {
 
+    decodeMessages++;
 
+    if (!quiet)
+        vprintf(format, args);
+}
 
+void EMObsReader::Reset() {
+    arena.Reset();
+}
 
-static void hexDump(const char* desc, long seekOffset, void* data, int len);
-static void DisplayEBS(struct _EBS* pEBS);
-static void DisplayIDA(struct _IDA* pIDA);
-static void DisplayCMS(struct _CMS* pCMS);
-static void DisplayPER(struct _PER* pPER);
-static void DisplayCCC(struct _CCC* pCCC);
-static void DisplayPDA(const wchar_t* pIndent, struct _PDA* pPDA);
-static void DisplayPDL(const wchar_t* pIndent, struct _PDL* pPDL);
-static void ClearOutputRow(struct _OutputRow* outputRow);
+const EMObsArenaStats& EMObsReader::GetArenaStats() const {
+    return arena.GetStats();
+}
 
-EMObsReader::EMObsReader(const std::string& _filespec) : filespec(_filespec) {
-    this->reader = new EMObsReaderBase(filespec);
+/// <summary>
+/// Start the record walk: load the file, release any previous parse tree and find the first TLC
+/// </summary>
+/// <returns>0 if ok</returns>
+int EMObsReader::WalkBegin() {
+
+    // Release any previous parse tree
+    arena.Reset();
+
+    walk.pEBS = nullptr;
+    walk.pIDA = nullptr;
+    walk.finished = false;
+    walk.resync = false;
+
+    walk.ret = reader->ReadFile();
+    if (walk.ret == 0)
+        walk.ret = WalkFindNext();
+
+    return walk.ret;
 }
 
-int EMObsReader::Process(std::list<struct _OutputRow*>& outputRowsAdd) {
-    int ret = 0;
-    struct _EBS* pEBS = nullptr;
-    std::list<struct _IDA*> IDAList;
-    std::list<struct _CMS*> CMSList;    // List of 2 items max
-    struct _PER* pPER = nullptr;
-    std::list<struct _CCC*> CCCList;    // List of 2 items max
-    bool finished = false;
+/// <summary>
+/// Find the record the walk decodes next. In grammar mode this is the TLC at the read pointer, where
+/// the previous record ended, and the buffer is only scanned (for the next TLC) to get back in step
+/// after a bad record or if there is no TLC there. In scan mode it is the next TLC after the seek
+/// pointer
+/// </summary>
+/// <returns>0 if ok, -1 at the end of the file (as GetNextTLC)</returns>
+int EMObsReader::WalkFindNext() {
+
+    if (walk.resync) {
+        walk.resync = false;
+        if (WalkResync() != 0)
+            return -1;
+        reader->SetSeekPointerToReadPointer();
+    }
+
+    if (decodeMode == EMObsDecodeMode::Scan)
+        return reader->GetNextTLC((void**)&walk.p, &walk.size, walk.TLC);
+
+    int ret = reader->GetTLCAtReadPointer(walk.TLC);
 
-    ret = reader->ReadFile();
+    if (ret == -1)
+        ret = reader->ResyncToNextTLC(walk.TLC) != -1 ? 0 : -1;
+    else if (ret == -2)
+        ret = -1;
 
+    // The size of the record isn't known until it is decoded
     if (ret == 0) {
+        walk.p = (unsigned char*)reader->GetBuffer() + reader->GetReadPointer();
+        walk.size = 0;
+    }
 
+    return ret;
+}
 
-        unsigned char* p;
-        int size;
-        char TLC[4];
-        ret = reader->GetFirstTLC((void**)&p, &size, TLC);
+/// <summary>
+/// Move the read pointer on to the next record the walk decodes after a bad one. The TLCs inside
+/// the bad record (FRA, PDA, MAT...) are skipped, the walk would stop at them as unsupported
+/// </summary>
+/// <returns>0 if ok, -1 if there are no more</returns>
+int EMObsReader::WalkResync() {
+
+    long offset;
+
+    while ((offset = reader->ResyncToNextTLC(walk.TLC)) != -1) {
+        switch (EMObsTLC(walk.TLC)) {
+        case EMObsSchema<_EBS>::tlc:
+        case EMObsSchema<_IDA>::tlc:
+        case EMObsSchema<_CMS>::tlc:
+        case EMObsSchema<_PER>::tlc:
+        case EMObsSchema<_CCC>::tlc:
+            return 0;
+        }
 
-        while (ret == 0 && finished == false) {
-            unsigned char* pAfterTLC = (unsigned char*)(p + 3);
-            int fixedSize = size;
+        reader->SetReadPointer(offset + 4);
+    }
 
+    return -1;
+}
 
-            if (strcmp(TLC, "EBS") == 0) {
+/// <summary>
+/// Decode the next EBS or IDA. The IDA returned by the previous call is released first, the EBS is
+/// kept for the rest of the walk. The walk ends at the CMS/PER/CCC that follow the measurements or
+/// at an unsupported TLC
+/// </summary>
+EMObsReader::WalkRecord EMObsReader::WalkNext() {
 
-                // Check this is only one EBS
-                if (pEBS != nullptr)
-                    wprintf(L"*** Warning more then one EBS detected!\n");
+    if (walk.pIDA != nullptr) {
+        arena.Rewind(walk.idaMark);
+        walk.pIDA = nullptr;
+    }
 
-                pEBS = GetEBS();
-                if (pEBS == nullptr) {
-                    wprintf(L"*** Error EBS not found!\n");
-                    break;
-                }
-                reader->SetSeekPointerToReadPointer();
+    while (walk.ret == 0 && walk.finished == false) {
+        WalkRecord record = WalkEnd;
+        int messages = decodeMessages;
 
-                // Print known information
-                DisplayEBS(pEBS);
-            }
-            else if (strcmp(TLC, "IDA") == 0) {
 
-                struct _IDA* pIDA = GetIDA();
-                reader->SetSeekPointerToReadPointer();
-                IDAList.push_back(pIDA);
+        switch (EMObsTLC(walk.TLC)) {
 
-                // Print known information
-                DisplayIDA(pIDA);
+        case EMObsSchema<_EBS>::tlc:
+
+            // Check this is only one EBS
+            if (walk.pEBS != nullptr)
+                wprintf(L"*** Warning more then one EBS detected!\n");
+
+            walk.pEBS = NewRecord<_EBS>();
+            if (walk.pEBS == nullptr) {
+                wprintf(L"*** Error EBS not found!\n");
+                walk.finished = true;
+                return WalkEnd;
             }
-            else if (strcmp(TLC, "CMS") == 0) {
-                finished = true;
+            reader->SetSeekPointerToReadPointer();
+            record = WalkEBS;
+            break;
+
+        case EMObsSchema<_IDA>::tlc:
 
-                //// Check this is a max of 2 CMS
-                //if (CMSList.size() >= 2)
-                //    wprintf(L"*** Warning more then two CMS detected!\n");
+            walk.idaMark = arena.GetMark();
 
-                //struct _CMS* pCMS = GetCMS();
-                //reader->SetSeekPointerToReadPointer();
-                //CMSList.push_back(pCMS);
+            walk.pIDA = NewRecord<_IDA>();
+            reader->SetSeekPointerToReadPointer();
+
+            if (walk.pIDA != nullptr)
+                record = WalkIDA;
+            else
+                arena.Rewind(walk.idaMark);
+            break;
+
+        case EMObsSchema<_CMS>::tlc:
+        case EMObsSchema<_PER>::tlc:
+        case EMObsSchema<_CCC>::tlc:
+            // CMS, PER and CCC follow the measurements and their contents are not known yet
+            walk.finished = true;
+            break;
+
+        default:
+            // In grammar mode the size of an unknown record is found by scanning for the next TLC
+            if (decodeMode == EMObsDecodeMode::Grammar)
+                reader->GetNextTLC((void**)&walk.p, &walk.size, walk.TLC);
+
+            printf("%08lX %s:\t%05i\t%i\t%i\n", reader->GetReadPointer(), walk.TLC, walk.size, (int)walk.p[3], walk.size);
+            // Display raw data
+            hexDump("*** Unsupported", -1, walk.p, (int)walk.size);
+            walk.finished = true;
+            break;
+        }
 
-                //// Print known information
-                //DisplayCMS(pCMS);
+        // After a bad record the read pointer may not be at the start of the next one
+        if (decodeMessages != messages)
+            walk.resync = true;
+
+        // A corrupt record, a bad length or count read past the end of the buffer. The read error
+        // left the read pointer at the end, the walk scans on from the record's TLC for the next one
+        // as after a decode error. With none left the file is truncated
+        if (reader->HasReadError()) {
+            long offset = reader->GetLastTLCSeekPointer();
+            char TLC[4];
+            memcpy(TLC, walk.TLC, sizeof(TLC));
+
+            reader->ClearReadError();
+            reader->SetReadPointer(offset + 4);
+            walk.resync = true;
+            walk.ret = WalkFindNext();
+
+            if (walk.ret == 0)
+                printf("*** Error %s at %08lX is corrupt, carrying on at %s at %08lX\n", TLC, offset, walk.TLC, reader->GetLastTLCSeekPointer());
+            else {
+                printf("*** Error %s at %08lX runs past the end of the file!\n", TLC, offset);
+                walk.finished = true;
+                walk.ret = -2;
             }
-            else if (strcmp(TLC, "PER") == 0) {
-                finished = true;
+        }
+        else
+            walk.ret = WalkFindNext();
 
-                //// Check this is only one EBS
-                //if (pPER != nullptr)
-                //    wprintf(L"*** Warning more then one EBS detected!\n");
+        if (record != WalkEnd)
+            return record;
+    }
 
-                //pPER = GetPER();
-                //reader->SetSeekPointerToReadPointer();
+    return WalkEnd;
+}
 
-                //// Print known information
-                //DisplayPER(pPER);
-            }
-            else if (strcmp(TLC, "CCC") == 0) {
-                finished = true;
+/// <summary>
+/// Decode the file and pass each record to the visitor as it is decoded. Only the header (EBS) and
+/// the IDA currently being visited are held in the arena
+/// </summary>
+/// <returns>0 if ok</returns>
+int EMObsReader::Parse(EMObsVisitor& visitor) {
 
-                //// Check this is a max of 2 CMS
-                //if (CCCList.size() >= 2)
-                //    wprintf(L"*** Warning more then two CCC detected!\n");
+    if (WalkBegin() != 0)
+        return walk.ret;
 
-                //struct _CCC* pCCC = GetCCC();
-                //reader->SetSeekPointerToReadPointer();
-                //CCCList.push_back(pCCC);
+    WalkRecord record;
+    while ((record = WalkNext()) != WalkEnd) {
 
-                //// Print known information
-                //DisplayCCC(pCCC);
-            }
-            else {
-                printf("%08lX %s:\t%05i\t%i\t%i\n", reader->GetReadPointer(), TLC, size, (int)*pAfterTLC, fixedSize);
-                // Display raw data
-                hexDump("*** Unsupported", -1, p, (int)size);
-                finished = true;
-            }
+        bool more;
+        if (record == WalkEBS)
+            more = visitor.onHeader(*walk.pEBS, walk.pEBS->pCIN, walk.pEBS->pPTN);
+        else
+            more = VisitIDA(visitor, *walk.pIDA);
 
-            ret = reader->GetNextTLC((void**)&p, &size, TLC);
+        // Stopped by the visitor
+        if (!more) {
+            walk.finished = true;
+            return 0;
         }
+    }
 
-        if (ret == 0 && pEBS != nullptr) {
+    return walk.ret;
+}
 
-            // Populate the OutputRow list
+/// <summary>
+/// Parse() with the IDAs decoded on worker threads. Each worker has its own cursor and arena over
+/// the same file buffer. Everything else (the EBS, the records after the IDAs and the visitor
+/// calls) happens on the calling thread, as in Parse()
+/// </summary>
+/// <returns>0 if ok</returns>
+int EMObsReader::Parse(EMObsVisitor& visitor, unsigned int _threads) {
 
-            // Grab the row from the previous _OutputRow item or if the list is empty set it to 1
-            int row = 1;
-            if (!outputRowsAdd.empty())
-                row = outputRowsAdd.back()->row + 1;
+    if (_threads == 0)
+        _threads = std::max(1u, std::thread::hardware_concurrency());
 
+    if (_threads == 1)
+        return Parse(visitor);
 
-            // pEBS->wsPictureDirectory;    // Path
-            struct _CIN* pCIN = pEBS->pCIN; // OpCode data
+    if (WalkBegin() != 0)
+        return walk.ret;
 
-            // Convert the filespec to a std::filesystem::path object
-            fs::path fullPath(filespec);
+    std::vector<std::unique_ptr<EMObsReader>> workers;
+    for (unsigned int i = 0; i < _threads; i++) {
+        workers.push_back(std::make_unique<EMObsReader>(filespec, reader->GetSource()));
+        workers.back()->reader->ReadFile();
+        workers.back()->quiet = true;
+    }
 
-            // Extract the path (without the filename)
-            fs::path PathEMObs = fullPath.parent_path();
+    bool tryRun = true;
 
-            // Extract the filename with extension
-            fs::path FileEMObs = fullPath.filename();
+    while (true) {
+        bool more;
 
+        // The walk decodes from the end of the previous record, so the IDA must start there
+        if (tryRun && walk.ret == 0 && walk.finished == false && EMObsTLC(walk.TLC) == EMObsSchema<_IDA>::tlc &&
+            reader->GetReadPointer() == reader->GetLastTLCSeekPointer()) {
 
-            // Range-based for loop (modern C++11)
-            for (_IDA* itemIDA : IDAList) {
+            size_t used = 0;
+            more = ParseIDARun(visitor, workers, &used);
 
-                struct _OutputRow* outputRow;
-                struct _FRA* pFRA = itemIDA->pFRA;
+            // A bad IDA at the start of the run is left to the walk
+            tryRun = used > 0;
+        }
+        else {
+            tryRun = true;
 
-                // Collect the PDA 2D point data
-                for (_PDA* itemPDA : itemIDA->TypePDA.PDAList) {
+            WalkRecord record = WalkNext();
+            if (record == WalkEnd)
+                break;
 
-                    outputRow = new struct _OutputRow;
-                    ClearOutputRow(outputRow);
-                    outputRow->row = row++;
+            if (record == WalkEBS)
+                more = visitor.onHeader(*walk.pEBS, walk.pEBS->pCIN, walk.pEBS->pPTN);
+            else
+                more = VisitIDA(visitor, *walk.pIDA);
+        }
 
-                    outputRow->PathEMObs = PathEMObs;
-                    outputRow->FileEMObs = FileEMObs;
-                    outputRow->Period = itemIDA->wsPeriodName;
-                    outputRow->opCode = pCIN->matValue[0][0];
-                    outputRow->Path = pEBS->wsPictureDirectory;
-                    if (pFRA->iCameraZeroLeftOneRight == 0) {// Left Camera
-                        outputRow->rowType = Point2DLeftCamera;
-                        outputRow->FileL = pFRA->wsMediaFile;
-                        outputRow->FrameL = pFRA->iFrameIndex;
-                        outputRow->PointLX1 = itemPDA->pCPT->X;
-                        outputRow->PointLY1 = itemPDA->pCPT->Y;
-                    }
-                    else if (pFRA->iCameraZeroLeftOneRight == 1) {// Right Camera
-                        outputRow->rowType = Point2DRightCamera;
-                        outputRow->FileR = pFRA->wsMediaFile;
-                        outputRow->FrameR = pFRA->iFrameIndex;
-                        outputRow->PointRX1 = itemPDA->pCPT->X;
-                        outputRow->PointRY1 = itemPDA->pCPT->Y;
-                    }
-                    else
-                        assert(false);
-
-                    outputRow->Family = itemPDA->matCollectionValues[0][0];
-                    outputRow->Genus = itemPDA->matCollectionValues[1][0];
-                    outputRow->Species = itemPDA->matCollectionValues[2][0];
-                    if (itemPDA->matCollectionValues[4][0].empty())
-                        outputRow->count = 1;
-                    else {
-                        try {
-                            outputRow->count = std::stoi(itemPDA->matCollectionValues[4][0]);
-                        }
-                        catch (const std::exception& e) {
-                            printf("Process: Bad fish count in PDA, on row: %i, setting count to -1, %s.", outputRow->row, e.what());
-                            outputRow->count = -1;
-                        }
-                    }
+        // Stopped by the visitor
+        if (!more) {
+            walk.finished = true;
+            return 0;
+        }
+    }
 
-                    outputRowsAdd.push_back(outputRow);
-                }
-                // Collect the PDL 3D measurment point data
-                for (_PDL* itemPDL : itemIDA->TypePDL.PDLList) {
-
-                    // It is assumes that the base FRA is the left camera and the PDL>FRA is the right camera
-                    assert(pFRA->iCameraZeroLeftOneRight == 0);
-                    assert(itemPDL->pFRA->iCameraZeroLeftOneRight == 1);
-
-                    outputRow = new struct _OutputRow;
-                    ClearOutputRow(outputRow);
-                    outputRow->row = row++;
-
-                    outputRow->PathEMObs = PathEMObs;
-                    outputRow->FileEMObs = FileEMObs;
-                    outputRow->Period = itemIDA->wsPeriodName;
-                    outputRow->opCode = pCIN->matValue[0][0];
-                    outputRow->rowType = MeasurementPoint3D;
-                    outputRow->Path = pEBS->wsPictureDirectory;
-                    outputRow->FileL = pFRA->wsMediaFile;
-                    outputRow->FrameL = pFRA->iFrameIndex;
-                    outputRow->PointLX1 = itemPDL->pCPT1->X;
-                    outputRow->PointLY1 = itemPDL->pCPT1->Y;
-                    outputRow->PointLX2 = itemPDL->pCPT2->X;
-                    outputRow->PointLY2 = itemPDL->pCPT2->Y;
-                    outputRow->FileR = itemPDL->pFRA->wsMediaFile;
-                    outputRow->FrameR = itemPDL->pFRA->iFrameIndex;
-                    outputRow->PointRX1 = itemPDL->pCPT3->X;
-                    outputRow->PointRY1 = itemPDL->pCPT3->Y;
-                    outputRow->PointRX2 = itemPDL->pCPT4->X;
-                    outputRow->PointRY2 = itemPDL->pCPT4->Y;
-
-                    outputRow->Family = itemPDL->matCollectionValues[0][0];
-                    outputRow->Genus = itemPDL->matCollectionValues[1][0];
-                    outputRow->Species = itemPDL->matCollectionValues[2][0];
-                    if (itemPDL->matCollectionValues[4][0].empty())
-                        outputRow->count = 1;
-                    else {
-                        try {
-                            outputRow->count = std::stoi(itemPDL->matCollectionValues[4][0]);
-                        }
-                        catch (const std::exception& e) {
-                            printf("Process: Bad fish count in PDL, on row: %i, setting count to -, %s.", outputRow->row, e.what());
-                            outputRow->count = -1;
-                        }
-                    }
+    return walk.ret;
+}
 
-                    outputRowsAdd.push_back(outputRow);
-                }
-                // Collect the PD3 3D point data
-                for (_PD3* itemPD3 : itemIDA->TypePD3.PD3List) {
-
-
-                    outputRow = new struct _OutputRow;
-                    ClearOutputRow(outputRow);
-                    outputRow->row = row++;
-
-                    outputRow->PathEMObs = PathEMObs;
-                    outputRow->FileEMObs = FileEMObs;
-                    outputRow->Period = itemIDA->wsPeriodName;
-                    outputRow->opCode = pCIN->matValue[0][0];
-                    outputRow->Path = pEBS->wsPictureDirectory;
-                    if (pFRA->iCameraZeroLeftOneRight == 0 && itemPD3->pFRA->iCameraZeroLeftOneRight == 1) {// should always be the case
-                        outputRow->rowType = Point3D;
-                        outputRow->FileL = pFRA->wsMediaFile;
-                        outputRow->FrameL = pFRA->iFrameIndex;
-                        outputRow->PointLX1 = itemPD3->pCPT1->X;
-                        outputRow->PointLY1 = itemPD3->pCPT1->Y;                        
-
-                        outputRow->FileR = itemPD3->pFRA->wsMediaFile;
-                        outputRow->FrameR = itemPD3->pFRA->iFrameIndex;
-                        outputRow->PointRX1 = itemPD3->pCPT2->X;
-                        outputRow->PointRY1 = itemPD3->pCPT2->Y;
-                    }
-                    else
-                        assert(false);
-
-                    outputRow->Family = itemPD3->matCollectionValues[0][0];
-                    outputRow->Genus = itemPD3->matCollectionValues[1][0];
-                    outputRow->Species = itemPD3->matCollectionValues[2][0];
-                    if (itemPD3->matCollectionValues[4][0].empty())
-                        outputRow->count = 1;
-                    else {
-                        try {
-                            outputRow->count = std::stoi(itemPD3->matCollectionValues[4][0]);
-                        }
-                        catch (const std::exception& e) {
-                            printf("Process: Bad fish count in PDS, on row: %i, setting count to -1, %s.", outputRow->row, e.what());
-                            outputRow->count = -1;
-                        }
-                    }
+// An IDA decoded by a Parse() worker
+struct _ParallelIDA {
+    long offset;
+    struct _IDA* pIDA;          // nullptr if it could not be decoded
+    long end;                   // Read pointer after the IDA
+    bool clean;                 // Decoded with no errors or warnings
+};
 
-                    outputRowsAdd.push_back(outputRow);
-                }
+/// <summary>
+/// Decode the run of IDAs from the walk's current TLC on the workers and then visit them in file
+/// order. The IDAs are found with the TLC index, which also holds the TLCs inside the records, so
+/// an IDA is only used if it starts where the previous one ended (where the walk would decode
+/// next). The walk then carries on after the last IDA used
+/// </summary>
+/// <param name="used">Set to the number of IDAs used</param>
+/// <returns>false if the visitor stopped the parse</returns>
+bool EMObsReader::ParseIDARun(EMObsVisitor& visitor, std::vector<std::unique_ptr<EMObsReader>>& workers, size_t* used) {
+
+    const size_t idasPerWorker = 256;   // Limits the IDAs held in the worker arenas at once
+    const size_t idasPerThread = 32;    // Fewer than this per thread isn't worth a thread
+
+    if (walk.pIDA != nullptr) {
+        arena.Rewind(walk.idaMark);
+        walk.pIDA = nullptr;
+    }
+
+    std::vector<struct _ParallelIDA> run;
+    size_t count = reader->GetTLCIndexCount();
+    for (long ordinal = reader->FindTLCIndexByOffset(reader->GetLastTLCSeekPointer());
+        ordinal != -1 && (size_t)ordinal < count && run.size() < idasPerWorker * workers.size(); ordinal++) {
+
+        const struct _TLCIndexEntry* entry = reader->GetTLCIndexEntry(ordinal);
+        if (EMObsTLC(entry->cTLC) == EMObsSchema<_IDA>::tlc)
+            run.push_back({ (long)entry->offset, nullptr, 0, false });
+    }
+
+    // Decode
+    std::atomic<size_t> next{ 0 };
+
+    auto decode = [&](EMObsReader* worker) {
+        size_t i;
+        while ((i = next++) < run.size()) {
+            worker->reader->ClearReadError();
+            worker->reader->SetReadPointer(run[i].offset);
+            worker->decodeMessages = 0;
+
+            run[i].pIDA = worker->NewRecord<_IDA>();
+            run[i].end = worker->reader->GetReadPointer();
+            run[i].clean = run[i].pIDA != nullptr && !worker->reader->HasReadError() && worker->decodeMessages == 0;
+        }
+    };
+
+    size_t threadCount = std::min(workers.size(), (run.size() + idasPerThread - 1) / idasPerThread);
+
+    std::vector<std::thread> threadList;
+    for (size_t t = 0; t < workers.size(); t++) {
+        workers[t]->arena.Reset();
+        if (t > 0 && t < threadCount)
+            threadList.emplace_back(decode, workers[t].get());
+    }
+    decode(workers[0].get());
+
+    for (std::thread& thread : threadList)
+        thread.join();
+
+    // Visit in file order
+    long pos = run.empty() ? reader->GetLastTLCSeekPointer() : run[0].offset;
+
+    for (size_t i = 0; i < run.size(); i++) {
+        const struct _ParallelIDA& item = run[i];
+
+        if (item.offset < pos)
+            continue;           // Inside the previous IDA
+        if (item.offset != pos)
+            break;              // Something other than an IDA is next
+
+        // A bad IDA is left to the walk, which decodes it again and reports the errors in order
+        if (!item.clean)
+            break;
+
+        pos = item.end;
+        (*used)++;
+
+        if (!VisitIDA(visitor, *item.pIDA))
+            return false;
+    }
+
+    // Carry on the walk after the last IDA
+    reader->SetReadPointer(pos);
+    reader->SetSeekPointerToReadPointer();
+    walk.ret = WalkFindNext();
+
+    return true;
+}
+
+bool EMObsReader::VisitIDA(EMObsVisitor& visitor, const struct _IDA& IDA) {
+
+    if (!visitor.onFrame(IDA, IDA.FRA))
+        return false;
+
+    for (const struct _PDA* pPDA : IDA.TypePDA.PDAList) {
+        if (!visitor.on2DPoint(IDA, *pPDA))
+            return false;
+    }
+
+    for (const struct _PDL* pPDL : IDA.TypePDL.PDLList) {
+        if (!visitor.on3DMeasurement(IDA, *pPDL))
+            return false;
+    }
+
+    for (const struct _PD3* pPD3 : IDA.TypePD3.PD3List) {
+        if (!visitor.on3DPoint(IDA, *pPD3))
+            return false;
+    }
+
+    return true;
+}
+
+
+/// <summary>
+/// Fill a row view from a record. These are shared by the row cursor and Process()
+/// </summary>
+static void RowFromIDA(EMObsRowView* view, const struct _EBS* pEBS, const struct _IDA& IDA) {
+
+    *view = EMObsRowView();
+    view->pIDA = &IDA;
+    view->Period = IDA.wsPeriodName;
+
+    if (pEBS != nullptr) {
+        view->Path = pEBS->wsPictureDirectory;
+        if (pEBS->pCIN != nullptr)
+            view->opCode = pEBS->pCIN->matValue.cell(0, 0);
+    }
+}
+
+static void RowSpecies(EMObsRowView* view, const EMObsMAT& matCollectionValues) {
+
+    view->Family = matCollectionValues.cell(0, 0);
+    view->Genus = matCollectionValues.cell(1, 0);
+    view->Species = matCollectionValues.cell(2, 0);
+
+    int32_t count = 0;
+    int countRet = matCollectionValues.AsInt(4, 0, &count);
+    if (countRet == 0)
+        view->count = count;
+    else if (countRet == -1)
+        view->count = 1;
+    else {
+        view->count = -1;
+        view->countError = true;
+    }
+}
+
+static void RowFrom2DPoint(EMObsRowView* view, const struct _EBS* pEBS, const struct _IDA& IDA, const struct _PDA& PDA) {
+
+    const struct _FRA* pFRA = &IDA.FRA;
+
+    RowFromIDA(view, pEBS, IDA);
+
+    if (pFRA->iCameraZeroLeftOneRight == 0) {// Left Camera
+        view->rowType = Point2DLeftCamera;
+        view->FileL = pFRA->wsMediaFile;
+        view->FrameL = pFRA->iFrameIndex;
+        view->PointLX1 = PDA.CPT.X;
+        view->PointLY1 = PDA.CPT.Y;
+    }
+    else if (pFRA->iCameraZeroLeftOneRight == 1) {// Right Camera
+        view->rowType = Point2DRightCamera;
+        view->FileR = pFRA->wsMediaFile;
+        view->FrameR = pFRA->iFrameIndex;
+        view->PointRX1 = PDA.CPT.X;
+        view->PointRY1 = PDA.CPT.Y;
+    }
+    else
+        assert(false);
+
+    RowSpecies(view, PDA.matCollectionValues);
+}
+
+static void RowFrom3DMeasurement(EMObsRowView* view, const struct _EBS* pEBS, const struct _IDA& IDA, const struct _PDL& PDL) {
+
+    const struct _FRA* pFRA = &IDA.FRA;
+
+    // It is assumes that the base FRA is the left camera and the PDL>FRA is the right camera
+    assert(pFRA->iCameraZeroLeftOneRight == 0);
+    assert(PDL.FRA.iCameraZeroLeftOneRight == 1);
+
+    RowFromIDA(view, pEBS, IDA);
+
+    view->rowType = MeasurementPoint3D;
+    view->FileL = pFRA->wsMediaFile;
+    view->FrameL = pFRA->iFrameIndex;
+    view->PointLX1 = PDL.CPT1.X;
+    view->PointLY1 = PDL.CPT1.Y;
+    view->PointLX2 = PDL.CPT2.X;
+    view->PointLY2 = PDL.CPT2.Y;
+    view->FileR = PDL.FRA.wsMediaFile;
+    view->FrameR = PDL.FRA.iFrameIndex;
+    view->PointRX1 = PDL.CPT3.X;
+    view->PointRY1 = PDL.CPT3.Y;
+    view->PointRX2 = PDL.CPT4.X;
+    view->PointRY2 = PDL.CPT4.Y;
+
+    RowSpecies(view, PDL.matCollectionValues);
+}
+
+static void RowFrom3DPoint(EMObsRowView* view, const struct _EBS* pEBS, const struct _IDA& IDA, const struct _PD3& PD3) {
+
+    const struct _FRA* pFRA = &IDA.FRA;
+
+    RowFromIDA(view, pEBS, IDA);
+
+    if (pFRA->iCameraZeroLeftOneRight == 0 && PD3.FRA.iCameraZeroLeftOneRight == 1) {// should always be the case
+        view->rowType = Point3D;
+        view->FileL = pFRA->wsMediaFile;
+        view->FrameL = pFRA->iFrameIndex;
+        view->PointLX1 = PD3.CPT1.X;
+        view->PointLY1 = PD3.CPT1.Y;
+
+        view->FileR = PD3.FRA.wsMediaFile;
+        view->FrameR = PD3.FRA.iFrameIndex;
+        view->PointRX1 = PD3.CPT2.X;
+        view->PointRY1 = PD3.CPT2.Y;
+    }
+    else
+        assert(false);
+
+    RowSpecies(view, PD3.matCollectionValues);
+}
+
+void EMObsRowView::ToOutputRow(struct _OutputRow* outputRow) const {
+
+    outputRow->opCode = opCode.ToWString();
+    outputRow->rowType = rowType;
+    outputRow->Period = Period.ToWString();
+    outputRow->Path = Path.ToWString();
+    outputRow->FileL = FileL.ToWString();
+    outputRow->FrameL = FrameL;
+    outputRow->PointLX1 = PointLX1;
+    outputRow->PointLY1 = PointLY1;
+    outputRow->PointLX2 = PointLX2;
+    outputRow->PointLY2 = PointLY2;
+    outputRow->FileR = FileR.ToWString();
+    outputRow->FrameR = FrameR;
+    outputRow->PointRX1 = PointRX1;
+    outputRow->PointRY1 = PointRY1;
+    outputRow->PointRX2 = PointRX2;
+    outputRow->PointRY2 = PointRY2;
+    outputRow->Family = Family.ToWString();
+    outputRow->Genus = Genus.ToWString();
+    outputRow->Species = Species.ToWString();
+    outputRow->count = count;
+}
+
+
+/// <summary>
+/// Start (or restart) the row cursor
+/// </summary>
+/// <returns>0 if ok</returns>
+int EMObsReader::OpenRows() {
+
+    rows.row = 0;
+    rows.stage = 0;
+    rows.index = 0;
+
+    return WalkBegin();
+}
+
+/// <summary>
+/// Decode up to the next measurement row. IDAs are only decoded when the rows of the previous one
+/// have all been returned
+/// </summary>
+/// <returns>false at the end of the file</returns>
+bool EMObsReader::NextRow(EMObsRowView* row) {
+
+    while (true) {
+        const struct _IDA* pIDA = walk.pIDA;
+
+        if (pIDA != nullptr) {
+            if (rows.stage == 0 && rows.index < pIDA->TypePDA.PDAList.size()) {
+                RowFrom2DPoint(row, walk.pEBS, *pIDA, *pIDA->TypePDA.PDAList.items[rows.index++]);
+                break;
+            }
+            if (rows.stage == 0) {
+                rows.stage = 1;
+                rows.index = 0;
+            }
+            if (rows.stage == 1 && rows.index < pIDA->TypePDL.PDLList.size()) {
+                RowFrom3DMeasurement(row, walk.pEBS, *pIDA, *pIDA->TypePDL.PDLList.items[rows.index++]);
+                break;
+            }
+            if (rows.stage == 1) {
+                rows.stage = 2;
+                rows.index = 0;
+            }
+            if (rows.index < pIDA->TypePD3.PD3List.size()) {
+                RowFrom3DPoint(row, walk.pEBS, *pIDA, *pIDA->TypePD3.PD3List.items[rows.index++]);
+                break;
             }
         }
+
+        // Move on to the next IDA (skipping the EBS)
+        if (WalkNext() == WalkEnd)
+            return false;
+
+        rows.stage = 0;
+        rows.index = 0;
+    }
+
+    row->row = ++rows.row;
+
+    return true;
+}
+
+EMObsRowRange EMObsReader::Rows() {
+    return EMObsRowRange(this);
+}
+
+
+/// <summary>
+/// Visitor used by Process() to display the records and build the output rows
+/// </summary>
+class OutputRowVisitor : public EMObsVisitor {
+public:
+    std::list<struct _OutputRow*> outputRows;
+    bool headerFound = false;
+
+    OutputRowVisitor(const std::string& filespec, int _row, bool _display) : row(_row), display(_display) {
+
+        // Convert the filespec to a std::filesystem::path object
+        fs::path fullPath(filespec);
+
+        // Extract the path (without the filename)
+        PathEMObs = fullPath.parent_path().wstring();
+
+        // Extract the filename with extension
+        FileEMObs = fullPath.filename().wstring();
+    }
+
+    ~OutputRowVisitor() {
+        for (struct _OutputRow* outputRow : outputRows)
+            delete outputRow;
     }
 
+    bool onHeader(const struct _EBS& EBS, const struct _CIN* pCIN, const struct _PTN* pPTN) override {
 
-    // Clear
-    if (pEBS)
-        delete pEBS;
+        // Print known information
+        if (display)
+            DisplayEBS((struct _EBS*)&EBS);
+
+        headerFound = true;
+        pEBS = &EBS;
+
+        return true;
+    }
+
+    bool onFrame(const struct _IDA& IDA, const struct _FRA& FRA) override {
+
+        // Print known information
+        if (display)
+            DisplayIDA((struct _IDA*)&IDA);
+
+        return true;
+    }
+
+    // Collect the PDA 2D point data
+    bool on2DPoint(const struct _IDA& IDA, const struct _PDA& PDA) override {
+
+        RowFrom2DPoint(&view, pEBS, IDA, PDA);
+        AddOutputRow("PDA");
+
+        return true;
+    }
+
+    // Collect the PDL 3D measurment point data
+    bool on3DMeasurement(const struct _IDA& IDA, const struct _PDL& PDL) override {
+
+        RowFrom3DMeasurement(&view, pEBS, IDA, PDL);
+        AddOutputRow("PDL");
+
+        return true;
+    }
+
+    // Collect the PD3 3D point data
+    bool on3DPoint(const struct _IDA& IDA, const struct _PD3& PD3) override {
+
+        RowFrom3DPoint(&view, pEBS, IDA, PD3);
+        AddOutputRow("PDS");
+
+        return true;
+    }
+
+private:
+    int row;
+    bool display;
+    std::wstring PathEMObs;
+    std::wstring FileEMObs;
+    const struct _EBS* pEBS = nullptr;
+    EMObsRowView view;
+
+    void AddOutputRow(const char* TLC) {
+
+        struct _OutputRow* outputRow = new struct _OutputRow;
+        ClearOutputRow(outputRow);
+        outputRow->row = row++;
+
+        outputRow->PathEMObs = PathEMObs;
+        outputRow->FileEMObs = FileEMObs;
+        view.ToOutputRow(outputRow);
+
+        if (view.countError)
+            printf("Process: Bad fish count in %s, on row: %i, setting count to -1.", TLC, outputRow->row);
+
+        outputRows.push_back(outputRow);
+    }
+};
+
+
+int EMObsReader::Process(std::list<struct _OutputRow*>& outputRowsAdd) {
+
+    // Grab the row from the previous _OutputRow item or if the list is empty set it to 1
+    int row = 1;
+    if (!outputRowsAdd.empty())
+        row = outputRowsAdd.back()->row + 1;
+
+    // The cache key includes a hash of the contents, so the file is loaded either way
+    std::string cachePath;
+    if (cache) {
+        cachePath = EMObsCachePath(filespec, cacheDirectory);
+
+        if (reader->ReadFile() == 0 &&
+            EMObsCacheLoad(cachePath, filespec, decodeMode, reader->GetBuffer(), reader->GetSize(), row, outputRowsAdd) == 0)
+            return 0;
+    }
+
+    OutputRowVisitor visitor(filespec, row, display);
+
+    int ret = Parse(visitor, threads);
+
+    // The rows are only kept (and cached) if the whole file was read
+    if (ret == 0 && visitor.headerFound) {
+        if (cache)
+            EMObsCacheSave(cachePath, filespec, decodeMode, reader->GetBuffer(), reader->GetSize(), visitor.outputRows);
+
+        outputRowsAdd.splice(outputRowsAdd.end(), visitor.outputRows);
+    }
 
     return ret;
 }
 
 static void DisplayEBS(struct _EBS* pEBS) {
-    wprintf(L"%08lX EBS: Picture Directory=[%ls]\n", pEBS->fileSeekPointer, pEBS->wsPictureDirectory.c_str());
+    wprintf(L"%08lX EBS: Picture Directory=[%ls]\n", pEBS->fileSeekPointer, pEBS->wsPictureDirectory.ToWString().c_str());
 
-    printf("%08lX EBS>CIN:  (Information Fields)\n", pEBS->pCIN->fileSeekPointer);
     if (pEBS->pCIN != nullptr) {
-        for (int i = 0; i < pEBS->pCIN->matTitle.size(); i++) {
-            if (!pEBS->pCIN->matTitle[i][0].empty() || !pEBS->pCIN->matValue[i][0].empty()) {
+        printf("%08lX EBS>CIN:  (Information Fields)\n", pEBS->pCIN->fileSeekPointer);
+        for (int i = 0; i < pEBS->pCIN->matTitle.GetDimX(); i++) {
+            if (!pEBS->pCIN->matTitle.cell(i, 0).empty() || !pEBS->pCIN->matValue.cell(i, 0).empty()) {
                 wprintf(L"       %02i: %ls = [%ls]\n",
                     i,
-                    pEBS->pCIN->matTitle[i][0].c_str(),
-                    pEBS->pCIN->matValue[i][0].c_str());
+                    pEBS->pCIN->matTitle.cell(i, 0).ToWString().c_str(),
+                    pEBS->pCIN->matValue.cell(i, 0).ToWString().c_str());
             }
         }
     }
     else
         wprintf(L"       error pEBS->pCIN null ptr\n");
 
-    printf("%08lX EBS>PTN:  (Collection Fields Titles)\n", pEBS->pPTN->fileSeekPointer);
     if (pEBS->pPTN != nullptr) {
-        for (int i = 0; i < pEBS->pPTN->matCollectionHeadings.size(); i++) {
-            if (!pEBS->pPTN->matCollectionHeadings[i][0].empty()) {
+        printf("%08lX EBS>PTN:  (Collection Fields Titles)\n", pEBS->pPTN->fileSeekPointer);
+        for (int i = 0; i < pEBS->pPTN->matCollectionHeadings.GetDimX(); i++) {
+            if (!pEBS->pPTN->matCollectionHeadings.cell(i, 0).empty()) {
                 wprintf(L"       %02i: Title = [%ls]\n",
                     i,
-                    pEBS->pPTN->matCollectionHeadings[i][0].c_str());
+                    pEBS->pPTN->matCollectionHeadings.cell(i, 0).ToWString().c_str());
             }
         }
     }
@@ -522,20 +874,20 @@ static void DisplayEBS(struct _EBS* pEBS) {
 
 static void DisplayIDA(struct _IDA* pIDA) {
 
-    if (pIDA != nullptr && pIDA->pFRA != nullptr) {
+    if (pIDA != nullptr) {
 
         wprintf(L"%08lX IDA>FRA: Left Frame=%i Camera=%s) Media=%ls\n",
             pIDA->fileSeekPointer,
-            pIDA->pFRA->iFrameIndex,
-            pIDA->pFRA->iCameraZeroLeftOneRight == 0 ? L"Left" : L"Right",
-            pIDA->pFRA->wsMediaFile.c_str());
+            pIDA->FRA.iFrameIndex,
+            pIDA->FRA.iCameraZeroLeftOneRight == 0 ? L"Left" : L"Right",
+            pIDA->FRA.wsMediaFile.ToWString().c_str());
 
         //???
-        if (pIDA->pFRA->iFrameIndex == 2243)
-            pIDA->pFRA->iFrameIndex = 2243;   // In File 6 at 2243 example of 3 PDA and two PDL 
+        if (pIDA->FRA.iFrameIndex == 2243)
+            pIDA->FRA.iFrameIndex = 2243;   // In File 6 at 2243 example of 3 PDA and two PDL 
 
-        if (!(pIDA->pFRA->iCameraZeroLeftOneRight == 0 || pIDA->pFRA->iCameraZeroLeftOneRight == 1))
-            wprintf(L"         ***IDA>FRA>iCameraZeroLeftOneRight should be either 0 or 1, and it is %i***\n", pIDA->pFRA->iCameraZeroLeftOneRight);
+        if (!(pIDA->FRA.iCameraZeroLeftOneRight == 0 || pIDA->FRA.iCameraZeroLeftOneRight == 1))
+            wprintf(L"         ***IDA>FRA>iCameraZeroLeftOneRight should be either 0 or 1, and it is %i***\n", pIDA->FRA.iCameraZeroLeftOneRight);
 
 
         if (pIDA->TypePDA.iPDACount > 0) {
@@ -548,7 +900,7 @@ static void DisplayIDA(struct _IDA* pIDA) {
         }
 
         hexDump("  IDA>Data1", -1, pIDA->data1.bData, sizeof(pIDA->data1.bData)/*16*/);
-        wprintf(L"    IDA>Period:[%ls]\n", pIDA->wsPeriodName.c_str());
+        wprintf(L"    IDA>Period:[%ls]\n", pIDA->wsPeriodName.ToWString().c_str());
 
 
         if (pIDA->TypePDL.iPDLCount > 0) {
@@ -562,10 +914,7 @@ static void DisplayIDA(struct _IDA* pIDA) {
         hexDump("  IDA>Data2", -1, pIDA->data2.bData, sizeof(pIDA->data2.bData));
     }
     else {
-        if (pIDA == nullptr)
-            wprintf(L"       error pIDA null ptr\n");
-        else if (pIDA->pFRA == nullptr)
-            wprintf(L"       error pIDA->pFRA null ptr\n");
+        wprintf(L"       error pIDA null ptr\n");
     }
 
     wprintf(L"\n");
@@ -573,20 +922,16 @@ static void DisplayIDA(struct _IDA* pIDA) {
 
 // Display a PDA which is beleived to be a EventMeasure Point
 static void DisplayPDA(const wchar_t* pIndent, struct _PDA* pPDA) {
-    if (pPDA->pCPT != nullptr) {
-        wprintf(L"%sPDA>CPT: X:%.2f Y:%.2f\n",
-            pIndent, pPDA->pCPT->X, pPDA->pCPT->Y);
-    }
-    else
-        wprintf(L"%s   error pPDA->pCPT null ptr\n", pIndent);
+    wprintf(L"%sPDA>CPT: X:%.2f Y:%.2f\n",
+        pIndent, pPDA->CPT.X, pPDA->CPT.Y);
 
     // Display MAT array
-    for (int i = 0; i < pPDA->matCollectionValues.size(); i++) {
-        if (!pPDA->matCollectionValues[i][0].empty()) {
+    for (int i = 0; i < pPDA->matCollectionValues.GetDimX(); i++) {
+        if (!pPDA->matCollectionValues.cell(i, 0).empty()) {
             wprintf(L"%s   %02i: Values = [%ls]\n",
                 pIndent,
                 i,
-                pPDA->matCollectionValues[i][0].c_str());
+                pPDA->matCollectionValues.cell(i, 0).ToWString().c_str());
         }
     }
 }
@@ -595,52 +940,33 @@ static void DisplayPDA(const wchar_t* pIndent, struct _PDA* pPDA) {
 static void DisplayPDL(const wchar_t* pIndent, struct _PDL* pPDL) {
 
     wprintf(L"    Left CPT Count: %i (should aways be 2)\n", pPDL->iData1);
-    if (pPDL->pCPT1 != nullptr) {
-        wprintf(L"    PDL>CPT1: X:%.2f, Y:%.2f\n",
-            pPDL->pCPT1->X, pPDL->pCPT1->Y);
-
-    }
-    else
-        wprintf(L"       error pPDL->pCPT1 null ptr\n");
+    wprintf(L"    PDL>CPT1: X:%.2f, Y:%.2f\n",
+        pPDL->CPT1.X, pPDL->CPT1.Y);
 
-    if (pPDL->pCPT2 != nullptr) {
-        wprintf(L"    PDL>CPT2: X:%.2f, Y:%.2f\n",
-            pPDL->pCPT2->X, pPDL->pCPT2->Y);
-    }
-    else
-        wprintf(L"       error pPDL->pCPT2 null ptr\n");
+    wprintf(L"    PDL>CPT2: X:%.2f, Y:%.2f\n",
+        pPDL->CPT2.X, pPDL->CPT2.Y);
 
     wprintf(L"    Right CPT Count: %i (should aways be 2)\n", pPDL->iData2);
 
-    if (pPDL->pCPT3 != nullptr) {
-        wprintf(L"    PDL>CPT3: X:%.2f, Y:%.2f\n",
-            pPDL->pCPT3->X, pPDL->pCPT3->Y);
-
-    }
-    else
-        wprintf(L"       error pPDL->pCPT3 null ptr\n");
-
-    if (pPDL->pCPT4 != nullptr) {
-        wprintf(L"    PDL>CPT4: X:%.2f, Y:%.2f\n",
-            pPDL->pCPT4->X, pPDL->pCPT4->Y);
+    wprintf(L"    PDL>CPT3: X:%.2f, Y:%.2f\n",
+        pPDL->CPT3.X, pPDL->CPT3.Y);
 
-    }
-    else
-        wprintf(L"       error pPDL->pCPT4 null ptr\n");
+    wprintf(L"    PDL>CPT4: X:%.2f, Y:%.2f\n",
+        pPDL->CPT4.X, pPDL->CPT4.Y);
 
 
-    for (int i = 0; i < pPDL->matCollectionValues.size(); i++) {
-        if (!pPDL->matCollectionValues[i][0].empty()) {
+    for (int i = 0; i < pPDL->matCollectionValues.GetDimX(); i++) {
+        if (!pPDL->matCollectionValues.cell(i, 0).empty()) {
             wprintf(L"       %02i: Values = [%ls]\n",
                 i,
-                pPDL->matCollectionValues[i][0].c_str());
+                pPDL->matCollectionValues.cell(i, 0).ToWString().c_str());
         }
     }
 
     wprintf(L"       IDA>FRA: Right Frame=%i (Camera=%s) Media=%ls\n",
-        pPDL->pFRA->iFrameIndex,
-        pPDL->pFRA->iCameraZeroLeftOneRight == 0 ? L"Left" : L"Right",
-        pPDL->pFRA->wsMediaFile.c_str());
+        pPDL->FRA.iFrameIndex,
+        pPDL->FRA.iCameraZeroLeftOneRight == 0 ? L"Left" : L"Right",
+        pPDL->FRA.wsMediaFile.ToWString().c_str());
 
 }
 
@@ -724,560 +1050,287 @@ static void hexDump(const char* desc, long seekOffset, void* data, int len) {
 
 
 /// <summary>
-/// File Header
-/// TLC=EBS Version = 4 or 5
-/// Children:
-///     WString:wsPictureDirectory Directory where the media is located
-///     TLC:CIN
-///     TLC:PTN
+/// Decode a record from the read pointer as described by its EMObsSchema: the TLC and version
+/// are loaded as one uint32_t, checked against the schema and then the fields of that version are
+/// decoded in order. Records with a header (all but CPT) keep the offset, TLC and version even if
+/// the decode fails
 /// </summary>
+template <typename Record>
+EMObsReader::DecodeResult EMObsReader::DecodeRecord(Record* pRecord) {
 
-struct _EBS* EMObsReader::GetEBS() {
-
-    int ret = 0;
-    struct _EBS* pEBS = new _EBS();
-
-    if (pEBS != nullptr) {
+    using Schema = EMObsSchema<Record>;
 
-        pEBS->fileSeekPointer = reader->GetReadPointer();
-        reader->GetNextAsFixedChar(pEBS->cTLC, 3);
-        reader->GetNextAsFixedChar(&pEBS->cTLCVersion, 1);
-        if (memcmp(pEBS->cTLC, "EBS", 3) == 0) {
+    long fileSeekPointer = reader->GetReadPointer();
+    int messages = decodeMessages;
 
-            if (pEBS->cTLCVersion == 4 || pEBS->cTLCVersion == 5) {
-                pEBS->wsPictureDirectory = reader->GetNextAsWString();
+    uint32_t header = (uint32_t)reader->GetNextAsInt32();
+    char version = (char)(header >> 24);
 
-                pEBS->pCIN = GetCIN();
-                pEBS->pPTN = GetPTN();
-            }
-            else {
-                printf("***GetEBS Error EBS, unexpected TLC version of %i found\n", (int)pEBS->cTLCVersion);
-                delete pEBS;
-                pEBS = nullptr;
-            }
-        }
-        else {
-            printf("***GetEBS Error EBS expected not found\n");
-            delete pEBS;
-            pEBS = nullptr;
-        }
+    if constexpr (EMObsHasHeader<Record>::value) {
+        pRecord->fileSeekPointer = fileSeekPointer;
+        memcpy(pRecord->cTLC, &header, 3);
+        pRecord->cTLCVersion = version;
     }
 
-    return pEBS;
-}
-
-/// <summary>
-/// Information Fields
-/// TLC=CIN Version = 0
-/// Children:
-///     TLC:MAT Information Field Titles
-///     TLC:MAT Information Field Values
-/// </summary>
-struct _CIN* EMObsReader::GetCIN() {
-
-    int ret = 0;
-    struct _CIN* pCIN = new _CIN();
-
-    if (pCIN != nullptr) {
-
-        pCIN->fileSeekPointer = reader->GetReadPointer();
-        reader->GetNextAsFixedChar(pCIN->cTLC, 3);
-        reader->GetNextAsFixedChar(&pCIN->cTLCVersion, 1);
-        if (memcmp(pCIN->cTLC, "CIN", 3) == 0) {
-
-            if (pCIN->cTLCVersion == 0) {
-                pCIN->matTitle = reader->GetNextAsMAT();
-                pCIN->matValue = reader->GetNextAsMAT();
-            }
-            else {
-                printf("***GetCIN Error CIN, unexpected TLC version of %i found\n", (int)pCIN->cTLCVersion);
-                delete pCIN;
-                pCIN = nullptr;
-            }
-        }
-        else {
-            printf("***GetCIN Error CIN expected not found\n");
-            delete pCIN;
-            pCIN = nullptr;
-        }
+    if ((header & 0xFFFFFF) != Schema::tlc) {
+        DecodeError("***Get%s Error %s expected not found\n", Schema::name, Schema::name);
+        return DecodeFailed;
     }
 
-    return pCIN;
-}
-
+    DecodeResult result = DecodeVersion(pRecord, version, typename Schema::Versions());
 
-/// <summary>
-/// Configurable header titles for what we are collecting
-/// TLC=PTN Version = 0
-/// Children:
-///     TLC:MAT Collection Field Titles
-/// </summary>
-struct _PTN* EMObsReader::GetPTN() {
-
-    int ret = 0;
-    struct _PTN* pPTN = new _PTN();
-
-    if (pPTN != nullptr) {
-
-        pPTN->fileSeekPointer = reader->GetReadPointer();
-        reader->GetNextAsFixedChar(pPTN->cTLC, 3);
-        reader->GetNextAsFixedChar(&pPTN->cTLCVersion, 1);
-        if (memcmp(pPTN->cTLC, "PTN", 3) == 0) {
-            if (pPTN->cTLCVersion == 0) {
-                pPTN->matCollectionHeadings = reader->GetNextAsMAT();
-                pPTN->iData1 = reader->GetNextAsInt32();
-            }
-            else {
-                printf("***GetPTN Error PTN, unexpected TLC version of %i found\n", (int)pPTN->cTLCVersion);
-                delete pPTN;
-                pPTN = nullptr;
-            }
-        }
-        else {
-            printf("***GetPTN Error PTN expected not found\n");
-            delete pPTN;
-            pPTN = nullptr;
-        }
+    // A read past the end of the buffer (a bad length or count, or the end of the file) that no
+    // nested record has already reported
+    if (result != DecodeFailed && reader->HasReadError() && decodeMessages == messages) {
+        DecodeError("***Get%s Error %s, corrupt or truncated\n", Schema::name, Schema::name);
+        result = DecodePartial;
     }
 
-    return pPTN;
+    return result;
 }
 
-
 /// <summary>
-/// Measurement data Top level element
-/// TLC=IDA Version = 5
-/// Children:
-///     TLC:FRA 
-///     TLC:PDA
-///     TLC:PDL
-///     TLC:PD3
-///     TLC:MAT
-///  TODO
+/// Allocate a record in the arena and decode it. nullptr if the decode failed, except that a
+/// keepPartial record is returned once its TLC and version have matched
 /// </summary>
-struct _IDA* EMObsReader::GetIDA() {
+template <typename Record>
+Record* EMObsReader::NewRecord() {
 
-    int ret = 0;
-    bool failed = false;
-    struct _IDA* pIDA = new _IDA();
-
-    if (pIDA != nullptr) {
-
-        pIDA->fileSeekPointer = reader->GetReadPointer();
-        reader->GetNextAsFixedChar(pIDA->cTLC, 3);
-        reader->GetNextAsFixedChar(&pIDA->cTLCVersion, 1);
-        if (memcmp(pIDA->cTLC, "IDA", 3) == 0) {
-            if (pIDA->cTLCVersion == 5) {
-
-                pIDA->pFRA = GetFRA();
-
-                // Get PDA Count
-                pIDA->TypePDA.iPDACount = reader->GetNextAsInt32();        // Seen as 3, 2, 1 & 0 maybe 3, 2 & 1 are PDA and 0 is PDL
-
-                int i;
-
-                for (i = 0; i < pIDA->TypePDA.iPDACount; i++) {
-                    struct _PDA* pPDA = GetPDA();
-                    if (pPDA != nullptr) {
-                        pIDA->TypePDA.PDAList.push_back(pPDA);
-                    }
-                    else {
-                        failed = true;
-                        break;
-                    }
-                }
+    Record* pRecord = arena.New<Record>();
 
-                if (!failed) {
-                    // Get data and period
+    if (pRecord != nullptr) {
+        DecodeResult result = DecodeRecord(pRecord);
 
-                    // Get the data
-                    reader->GetNextAsFixedChar(pIDA->data1.bData, sizeof(pIDA->data1.bData));
-                    // Get the Period Name
-                    pIDA->wsPeriodName = reader->GetNextAsWString();
-
-
-                    // Get PDL Count
-                    pIDA->TypePDL.iPDLCount = reader->GetNextAsInt32();        // Seen as 3, 2, 1 & 0 maybe 3, 2 & 1 are PDA and 0 is PDL
-
-                    for (i = 0; i < pIDA->TypePDL.iPDLCount; i++) {
-                        struct _PDL* pPDL = GetPDL();
-                        if (pPDL != nullptr) {
-                            pIDA->TypePDL.PDLList.push_back(pPDL);
-                        }
-                        else {
-                            failed = true;
-                            break;
-                        }
-                    }
-
-                    if (!failed) {
-
-                        // Get PD3 Count
-                        pIDA->TypePD3.iPD3Count = reader->GetNextAsInt32();        // Seen as 3, 2, 1 & 0 maybe 3, 2 & 1 are PDA and 0 is PDL
-
-                        for (i = 0; i < pIDA->TypePD3.iPD3Count; i++) {
-                            struct _PD3* pPD3 = GetPD3();
-                            if (pPD3 != nullptr) {
-                                pIDA->TypePD3.PD3List.push_back(pPD3);
-                            }
-                            else {
-                                failed = true;
-                                break;
-                            }
-                        }
-
-                        if (!failed) {
-                            // Get end type data
-                            reader->GetNextAsFixedChar(pIDA->data2.bData, sizeof(pIDA->data2.bData));
-                        }
-                    }
-                }
-            }
-            else {
-                printf("***GetIDA Error IDA, unexpected TLC version of %i found\n", (int)pIDA->cTLCVersion);
-                delete pIDA;
-                pIDA = nullptr;
-            }
-        }
-        else {
-            printf("***GetIDA Error IDA expected not found\n");
-            delete pIDA;
-            pIDA = nullptr;
-        }
+        if (result == DecodeFailed || (result == DecodePartial && !EMObsSchema<Record>::keepPartial))
+            pRecord = nullptr;
     }
 
-    return pIDA;
+    return pRecord;
 }
 
-
 /// <summary>
-/// Frame data: Which left or right camera, frame number and media file
-/// TLC=FRA Version = 1
-/// Children:
-///     TLC:MAT
+/// Pick the EMObsVersion that matches the version byte
 /// </summary>
-struct _FRA* EMObsReader::GetFRA() {
+template <typename Record, typename... Versions>
+EMObsReader::DecodeResult EMObsReader::DecodeVersion(Record* pRecord, char version, EMObsVersions<Versions...>) {
 
-    int ret = 0;
-    struct _FRA* pFRA = new _FRA();
-
-    if (pFRA != nullptr) {
-
-        pFRA->fileSeekPointer = reader->GetReadPointer();
-        reader->GetNextAsFixedChar(pFRA->cTLC, 3);
-        reader->GetNextAsFixedChar(&pFRA->cTLCVersion, 1);
-        if (memcmp(pFRA->cTLC, "FRA", 3) == 0) {
-            if (pFRA->cTLCVersion == 1) {
-                pFRA->iCameraZeroLeftOneRight = reader->GetNextAsInt32();
-                pFRA->iFrameIndex = reader->GetNextAsInt32();	// Frame Number
-                pFRA->wsMediaFile = reader->GetNextAsWString();
-            }
-            else {
-                printf("***GetFRA Error FRA, unexpected TLC version of %i found\n", (int)pFRA->cTLCVersion);
-                delete pFRA;
-                pFRA = nullptr;
-            }
-        }
-        else {
-            printf("***GetFRA Error FRA expected not found\n");
-            delete pFRA;
-            pFRA = nullptr;
-        }
-    }
+    DecodeResult result = DecodeFailed;
 
-    return pFRA;
-}
+    bool found = ((version == Versions::version ?
+        (result = DecodeFields(pRecord, Versions(), std::make_index_sequence<Versions::fieldCount>()) ? DecodeOk : DecodePartial, true) : false) || ...);
 
+    if (!found)
+        DecodeError("***Get%s Error %s, unexpected TLC version of %i found\n", EMObsSchema<Record>::name, EMObsSchema<Record>::name, (int)version);
 
-/// <summary>
-/// 2D Point data
-/// TLC=PDA Version = 0 or 1
-/// Children:
-///     TLC:CPT
-///     TLC:MAT Collection Values
-///  TODO
-/// </summary>
-struct _PDA* EMObsReader::GetPDA() {
-
-    int ret = 0;
-    struct _PDA* pPDA = new _PDA();
-
-    if (pPDA != nullptr) {
-
-        pPDA->fileSeekPointer = reader->GetReadPointer();
-        reader->GetNextAsFixedChar(pPDA->cTLC, 3);
-        reader->GetNextAsFixedChar(&pPDA->cTLCVersion, 1);
-        // No sure why both 0 and 1 is possible the value most normally is 1
-        if (memcmp(pPDA->cTLC, "PDA", 3) == 0) {
-            if (pPDA->cTLCVersion == 0 || pPDA->cTLCVersion == 1) {
-
-                pPDA->pCPT = GetCPT();
-                pPDA->matCollectionValues = reader->GetNextAsMAT();
-
-                if (pPDA->cTLCVersion == 1) {
-                    reader->GetNextAsFixedChar(pPDA->bData, sizeof(pPDA->bData));
-                }
-            }
-            else {
-                printf("***GetPDA Error PDA, unexpected TLC version of %i found\n", (int)pPDA->cTLCVersion);
-                delete pPDA;
-                pPDA = nullptr;
-            }
-        }
-        else {
-            printf("***GetPDA Error PDA expected not found\n");
-            delete pPDA;
-            pPDA = nullptr;
-        }
-    }
-
-    return pPDA;
+    return result;
 }
 
-
 /// <summary>
-/// 3D Measurement Point (2x3D points in the left camera frame and 2x3D points in the right camera frame)
-/// TLC=PDL Version = 1
-/// Children:
-///     TLC: CPT
-///     TLC: FRA
-///     TLC: MAT 
+/// Decode the fields in order. The smallest size of the version is required once, so the fixed
+/// size fields at the start are loaded without a check. The rest check for themselves and a read
+/// past the end only sets the sticky read error, so it is tested once for the record (and before
+/// each nested record or list)
 /// </summary>
-struct _PDL* EMObsReader::GetPDL() {
+template <typename Record, char Version, typename... Fields, size_t... Index>
+bool EMObsReader::DecodeFields(Record* pRecord, EMObsVersion<Version, Fields...>, std::index_sequence<Index...>) {
 
-    int ret = 0;
-    struct _PDL* pPDL = new _PDL();
-
-    if (pPDL != nullptr) {
-
-        pPDL->fileSeekPointer = reader->GetReadPointer();
-        reader->GetNextAsFixedChar(pPDL->cTLC, 3);
-        reader->GetNextAsFixedChar(&pPDL->cTLCVersion, 1);
-        if (memcmp(pPDL->cTLC, "PDL", 3) == 0) {
-            if (pPDL->cTLCVersion == 1) {
-
-                pPDL->iData1 = reader->GetNextAsInt32();        // Seen as 2
-                if (pPDL->iData1 != 2)
-                    wprintf(L"*** Warning PDL iData1 not 2\n");
-
-                pPDL->pCPT1 = GetCPT();
-                pPDL->pCPT2 = GetCPT();
-                pPDL->iData2 = reader->GetNextAsInt32();        // Seen as 2
-                if (pPDL->iData2 != 2)
-                    wprintf(L"*** Warning PDL iData2 not 2\n");
-
-                pPDL->pCPT3 = GetCPT();
-                pPDL->pCPT4 = GetCPT();
-                pPDL->pFRA = GetFRA();
-                pPDL->matCollectionValues = reader->GetNextAsMAT();
-            }
-            else {
-                printf("***GetPDL Error PDL, unexpected TLC version of %i found\n", (int)pPDL->cTLCVersion);
-                delete pPDL;
-                pPDL = nullptr;
-            }
-        }
-        else {
-            printf("***GetPDL Error PDL expected not found\n");
-            delete pPDL;
-            pPDL = nullptr;
-        }
-    }
+    using Layout = EMObsVersion<Version, Fields...>;
 
-    return pPDL;
-}
+    if (!reader->Require(Layout::minSize - sizeof(uint32_t)))
+        return false;
 
+    return (DecodeField<Record, Fields, (Index < Layout::fixedFields)>(pRecord) && ...) && !reader->HasReadError();
+}
 
 /// <summary>
-/// 3D Point (2x3D points on either the left or right camera)
-/// TLC=PDL Version = 0
-/// Children:
-///     TLC: CPT
-///     TLC: FRA
-///     TLC: MAT 
+/// Decode one field, see EMObsField for how the member type is decoded. A Fixed field is known to
+/// be in the buffer
 /// </summary>
-struct _PD3* EMObsReader::GetPD3() {
-
-    int ret = 0;
-    struct _PD3* pPD3 = new _PD3();
+/// <returns>false if the record can't carry on</returns>
+template <typename Record, typename Field, bool Fixed>
+bool EMObsReader::DecodeField(Record* pRecord) {
 
-    if (pPD3 != nullptr) {
+    using Type = typename Field::Type;
+    Type& field = pRecord->*Field::member;
+    bool ok = true;
 
-        pPD3->fileSeekPointer = reader->GetReadPointer();
-        reader->GetNextAsFixedChar(pPD3->cTLC, 3);
-        reader->GetNextAsFixedChar(&pPD3->cTLCVersion, 1);
-        if (memcmp(pPD3->cTLC, "PD3", 3) == 0) {
-            if (pPD3->cTLCVersion == 0) {
+    if constexpr (std::is_same<Type, int32_t>::value) {
+        if constexpr (Fixed)
+            field = reader->Load<int32_t>();
+        else
+            field = reader->GetNextAsInt32();
 
-                pPD3->pCPT1 = GetCPT();
-                pPD3->pCPT2 = GetCPT();
-                pPD3->pFRA = GetFRA();
-                pPD3->matCollectionValues = reader->GetNextAsMAT();
-            }
-            else {
-                printf("***GetPD3 Error PD3, unexpected TLC version of %i found\n", (int)pPD3->cTLCVersion);
-                delete pPD3;
-                pPD3 = nullptr;
-            }
+        if constexpr ((Field::flags & EMObsFieldExpect) != 0) {
+            if (field != Field::expected && !reader->HasReadError())
+                DecodeWarning("*** Warning %s at %08lX has %i where %i was expected\n",
+                    EMObsSchema<Record>::name, reader->GetReadPointer() - (long)sizeof(int32_t), (int)field, (int)Field::expected);
         }
-        else {
-            printf("***GetPD3 Error PD3 expected not found\n");
-            delete pPD3;
-            pPD3 = nullptr;
+    }
+    else if constexpr (std::is_same<Type, EMObsWStringView>::value) {
+        field = reader->GetNextAsWStringView();
+    }
+    else if constexpr (std::is_same<Type, EMObsMAT>::value) {
+        field = reader->GetNextAsMAT(arena);
+    }
+    else if constexpr (EMObsIsRecord<Type>::value) {
+        ok = !reader->HasReadError() && DecodeRecord(&field) == DecodeOk;
+        if (!ok)
+            field = Type();
+    }
+    else if constexpr (std::is_pointer<Type>::value) {
+        field = reader->HasReadError() ? nullptr : NewRecord<std::remove_pointer_t<Type>>();
+        ok = field != nullptr;
+    }
+    else if constexpr (std::is_class<Type>::value && !std::is_union<Type>::value) {
+        // A list of child records: { int32_t count, EMObsArenaArray<record*> }
+        auto& [count, list] = field;
+        using Child = std::remove_pointer_t<typename std::remove_reference_t<decltype(list)>::value_type>;
+
+        count = reader->GetNextAsInt32();
+        ok = !reader->HasReadError() && list.Init(arena, RecordCapacity(reader, count, EMObsSchema<Child>::minSize));
+
+        for (int32_t i = 0; ok && i < count; i++) {
+            Child* pChild = NewRecord<Child>();
+            ok = pChild != nullptr && list.push_back(pChild);
         }
     }
+    else {
+        static_assert(std::is_trivially_copyable<Type>::value, "Raw EMObs fields are copied from the file");
+        if constexpr (Fixed)
+            reader->Load(&field, sizeof(Type));
+        else
+            reader->GetNextAsFixedChar((char*)&field, sizeof(Type));
+    }
 
-    return pPD3;
+    return ok || (Field::flags & EMObsFieldOptional) != 0;
 }
 
-/// <summary>
-/// Coordinate Point
-/// TLC=CPT Version = 0
-/// </summary>
-struct _CPT* EMObsReader::GetCPT() {
 
-    int ret = 0;
-    struct _CPT* pCPT = new _CPT();
+const EMObsRecordInfo* EMObsFindRecordInfo(uint32_t tlc, char version) {
+
+    for (const EMObsRecordInfo& info : emobsRecordTable) {
+        if (info.tlc == tlc && info.version == version)
+            return &info;
+    }
 
-    if (pCPT != nullptr) {
+    return nullptr;
+}
 
-        reader->GetNextAsFixedChar(pCPT->cTLC, 3);
-        reader->GetNextAsFixedChar(&pCPT->cTLCVersion, 1);
-        if (memcmp(pCPT->cTLC, "CPT", 3) == 0) {
-            if (pCPT->cTLCVersion == 0) {
+bool EMObsIsKnownTLC(uint32_t tlc) {
 
-                pCPT->X = reader->GetNextAsDouble();
-                pCPT->Y = reader->GetNextAsDouble();
-            }
-            else {
-                printf("***GetCPT Error CPT, unexpected TLC version of %i found\n", (int)pCPT->cTLCVersion);
-                delete pCPT;
-                pCPT = nullptr;
-            }
-        }
-        else {
-            printf("***GetCPT20 Error CPT expected not found\n");
-            delete pCPT;
-            pCPT = nullptr;
-        }
+    for (const EMObsRecordInfo& info : emobsRecordTable) {
+        if (info.tlc == tlc)
+            return true;
     }
 
-    return pCPT;
+    return false;
 }
 
 
+
 /// <summary>
-/// ???
-/// TLC=CMS Version = 1
-/// Children:
-///  TODO
+/// Make an owned copy of the string. wchar_t is UTF-16 on Windows so this is a straight copy,
+/// elsewhere wchar_t is UTF-32 so surrogate pairs are combined
 /// </summary>
-struct _CMS* EMObsReader::GetCMS() {
+std::wstring EMObsWStringView::ToWString() const {
 
-    int ret = 0;
-    struct _CMS* pCMS = new _CMS();
+    std::wstring ret;
 
-    if (pCMS != nullptr) {
+    if (length <= 0)
+        return ret;
 
-        pCMS->fileSeekPointer = reader->GetReadPointer();
-        reader->GetNextAsFixedChar(pCMS->cTLC, 3);
-        reader->GetNextAsFixedChar(&pCMS->cTLCVersion, 1);
-        if (memcmp(pCMS->cTLC, "CMS", 3) == 0) {
-            if (pCMS->cTLCVersion == 1) {
+#if WCHAR_MAX <= 0xFFFF
+    ret.resize((size_t)length);
+    memcpy(&ret[0], data, (size_t)length * sizeof(char16_t));
+#else
+    ret.reserve((size_t)length);
 
-                /// TODO
-            }
-            else {
-                printf("***GetCMS Error CMS, unexpected TLC version of %i found\n", (int)pCMS->cTLCVersion);
-                delete pCMS;
-                pCMS = nullptr;
+    for (size_t i = 0; i < (size_t)length; i++) {
+        char32_t c = at(i);
+
+        if (c >= 0xD800 && c <= 0xDBFF && i + 1 < (size_t)length) {
+            char32_t low = at(i + 1);
+            if (low >= 0xDC00 && low <= 0xDFFF) {
+                c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+                i++;
             }
         }
-        else {
-            printf("***GetCMS Error CMS expected not found\n");
-            delete pCMS;
-            pCMS = nullptr;
-        }
+
+        ret.push_back((wchar_t)c);
     }
+#endif
 
-    return pCMS;
+    return ret;
 }
 
+
 /// <summary>
-/// ???
-/// TLC=PER Version = 0
-/// Children:
-///  TODO
+/// Make the view of cell x,y from its offset. The cell is a length prefixed UTF-16 string, as read
+/// by GetNextAsWStringView
 /// </summary>
-struct _PER* EMObsReader::GetPER() {
+EMObsWStringView EMObsMAT::cell(int32_t x, int32_t y) const {
 
-    int ret = 0;
-    struct _PER* pPER = new _PER();
+    EMObsWStringView ret;
 
-    if (pPER != nullptr) {
+    if (buffer == nullptr || x < 0 || y < 0 || x >= dimX || y >= dimY)
+        return ret;
 
-        pPER->fileSeekPointer = reader->GetReadPointer();
-        reader->GetNextAsFixedChar(pPER->cTLC, 3);
-        reader->GetNextAsFixedChar(&pPER->cTLCVersion, 1);
-        if (memcmp(pPER->cTLC, "PER", 3) == 0) {
-            if (pPER->cTLCVersion == 0) {
+    const unsigned char* p = buffer + offsets[(size_t)y * (size_t)dimX + (size_t)x];
 
-                /// TODO
-            }
-            else {
-                printf("***GetPER Error PER, unexpected TLC version of %i found\n", (int)pPER->cTLCVersion);
-                delete pPER;
-                pPER = nullptr;
-            }
-        }
-        else {
-            printf("***GetPER Error PER expected not found\n");
-            delete pPER;
-            pPER = nullptr;
-        }
-    }
+    int32_t stringSize;
+    memcpy(&stringSize, p, sizeof(int32_t));
+    stringSize = -stringSize;
+    if (stringSize < 0)
+        stringSize = 0;
 
-    return pPER;
-}
+    ret.data = p + sizeof(int32_t);
+    ret.length = stringSize;
 
+    return ret;
+}
 
 /// <summary>
-/// ???
-/// TLC=CCC Version = 0
-/// Children:
-///  TODO
+/// Parse cell x,y as a decimal integer straight from the UTF-16 data. Follows std::stoi i.e.
+/// leading white space and a sign are allowed, and parsing stops at the first non digit
 /// </summary>
-struct _CCC* EMObsReader::GetCCC() {
+/// <returns>0 if ok, -1 if the cell is empty (or out of range), -2 if not a number</returns>
+int EMObsMAT::AsInt(int32_t x, int32_t y, int32_t* value) const {
 
-    int ret = 0;
-    struct _CCC* pCCC = new _CCC();
+    EMObsWStringView view = cell(x, y);
+    if (view.empty())
+        return -1;
 
-    if (pCCC != nullptr) {
+    size_t i = 0;
+    size_t len = view.size();
 
-        pCCC->fileSeekPointer = reader->GetReadPointer();
-        reader->GetNextAsFixedChar(pCCC->cTLC, 3);
-        reader->GetNextAsFixedChar(&pCCC->cTLCVersion, 1);
-        if (memcmp(pCCC->cTLC, "CCC", 3) == 0) {
-            if (pCCC->cTLCVersion == 0) {
+    while (i < len && iswspace((wint_t)view.at(i)))
+        i++;
 
-                /// TODO
-            }
-            else {
-                printf("***GetCCC Error CCC, unexpected TLC version of %i found\n", (int)pCCC->cTLCVersion);
-                delete pCCC;
-                pCCC = nullptr;
-            }
-        }
-        else {
-            printf("***GetCCC Error CCC expected not found\n");
-            delete pCCC;
-            pCCC = nullptr;
-        }
+    bool negative = false;
+    if (i < len && (view.at(i) == u'+' || view.at(i) == u'-')) {
+        negative = view.at(i) == u'-';
+        i++;
     }
 
-    return pCCC;
-}
+    int64_t result = 0;
+    size_t digits = 0;
+    for (; i < len && view.at(i) >= u'0' && view.at(i) <= u'9'; i++, digits++) {
+        result = result * 10 + (view.at(i) - u'0');
+        if (result > (int64_t)INT32_MAX + 1)
+            return -2;
+    }
+
+    if (digits == 0)
+        return -2;
 
+    if (negative)
+        result = -result;
+    if (result > INT32_MAX || result < INT32_MIN)
+        return -2;
+
+    *value = (int32_t)result;
+    return 0;
+}
 
 
 /// <summary>
@@ -1285,36 +1338,62 @@ struct _CCC* EMObsReader::GetCCC() {
 /// </summary>
 /// <param name="_fileSpec"></param>
 EMObsReaderBase::EMObsReaderBase(std::string& _fileSpec) : filespec(_fileSpec) {
-    readBuffer = nullptr;
 }
 
 EMObsReaderBase::~EMObsReaderBase() {
-    free(this->readBuffer);
 }
 
+/// <summary>
+/// Open the file as a read-only memory-mapped span. If a source was already set with SetSource()
+/// (or the file was opened by a previous call) then that is used and the cursors are reset
+/// </summary>
+/// <returns>0 if ok, -1 if the file could not be opened</returns>
 int EMObsReaderBase::ReadFile() {
     int ret = 0;
 
-    long size = getFileSize(this->filespec);
+    if (source == nullptr)
+        source = EMObsOpenFileSource(filespec);
 
-    readBuffer = (unsigned char*)malloc(size);
+    if (source != nullptr) {
+        readBuffer = source->GetData();
+        readBufferSize = source->GetSize();
 
-    if (readBuffer != NULL) {
-        readBufferSize = size;
+        readPointer = 0;
+        seekPointer = 0;
+        lastTLCSeekPointer = 0;
+        readError = false;
 
-        bool ok = readFileIntoBuffer(filespec, readBuffer, readBufferSize);
-
-        if (ok) {
-            readPointer = 0;
-            seekPointer = 0;
-        }
-        else
-            ret = -1;
+        tlcIndex.clear();
+        tlcIndexBuilt = false;
     }
+    else
+        ret = -1;
 
     return ret;
 }
 
+/// <summary>
+/// Use an already loaded file instead of opening filespec in ReadFile()
+/// </summary>
+void EMObsReaderBase::SetSource(std::shared_ptr<EMObsFileSource> _source) {
+    source = _source;
+}
+
+/// <summary>
+/// The loaded file, nullptr before ReadFile()/SetSource()
+/// </summary>
+std::shared_ptr<EMObsFileSource> EMObsReaderBase::GetSource() {
+    return source;
+}
+
+/// <summary>
+/// Return the start of the read buffer
+/// </summary>
+/// <returns></returns>
+const unsigned char* EMObsReaderBase::GetBuffer() {
+    return readBuffer;
+}
+
 /// <summary>
 /// Return the size of the read buffer
 /// </summary>
@@ -1352,115 +1431,172 @@ int EMObsReaderBase::PeekNextTLC(char* TLC) {
     return ret;
 }
 
+/// <summary>
+/// As PeekNextTLC but the TLC at the read pointer also becomes the last TLC found, as if
+/// GetNextTLC had found it, without scanning the buffer
+/// </summary>
+int EMObsReaderBase::GetTLCAtReadPointer(char* TLC) {
+
+    int ret = PeekNextTLC(TLC);
+
+    if (ret == 0) {
+        lastTLCSeekPointer = readPointer;
+        seekPointer = readPointer;
+    }
+
+    return ret;
+}
+
+/// <summary>
+/// Move the read pointer on to the next TLC at or after it. Used to get back in step with the
+/// records after a decode error
+/// </summary>
+/// <returns>The offset of the TLC or -1 if there are no more</returns>
+long EMObsReaderBase::ResyncToNextTLC(char* TLC) {
+
+    long ret = findNextTLC(readPointer, TLC);
+
+    if (ret != -1) {
+        readPointer = ret;
+        seekPointer = ret;
+        lastTLCSeekPointer = ret;
+    }
+
+    return ret;
+}
+
 long EMObsReaderBase::GetReadPointer() {
     return readPointer;
 }
 
 std::wstring EMObsReaderBase::GetNextAsWString() {
 
-    std::wstring ret;
+    return GetNextAsWStringView().ToWString();
+}
+
+void EMObsReaderBase::SetReadError() {
+    readError = true;
+    readPointer = (long)readBufferSize;
+}
 
-    int32_t stringSize = -GetNextAsInt32();
-    wchar_t* p = (wchar_t*)&readBuffer[readPointer];
+/// <summary>
+/// Read a length prefixed UTF-16 string without copying it. The length is stored as a negative
+/// int32_t count of UTF-16 code units. A length past the end of the buffer is a read error
+/// </summary>
+EMObsWStringView EMObsReaderBase::GetNextAsWStringView() {
 
-    std::wstring s(p, stringSize);
-    readPointer += stringSize * sizeof(wchar_t);
+    EMObsWStringView ret;
 
-    return s;
-}
+    int64_t stringSize = -(int64_t)GetNextAsInt32();
+    if (stringSize < 0)
+        stringSize = 0;
 
-std::int64_t EMObsReaderBase::GetNextAsInt64()
-{
-    int64_t ret = 0;
-    int64_t* p = (int64_t*)&readBuffer[readPointer];
+    if (!Require((size_t)stringSize * sizeof(char16_t)))
+        return ret;
 
-    ret = *p;
-    readPointer += sizeof(int64_t);
+    ret.data = &readBuffer[readPointer];
+    ret.length = (int32_t)stringSize;
+    readPointer += (long)stringSize * (long)sizeof(char16_t);
 
     return ret;
 }
 
-std::int32_t EMObsReaderBase::GetNextAsInt32()
+std::int64_t EMObsReaderBase::GetNextAsInt64()
 {
-    int32_t ret = 0;
-    int32_t* p = (int32_t*)&readBuffer[readPointer];
-
-    ret = *p;
-    readPointer += sizeof(int32_t);
+    return Require(sizeof(int64_t)) ? Load<int64_t>() : 0;
+}
 
-    return ret;
+std::int32_t EMObsReaderBase::GetNextAsInt32()
+{
+    return Require(sizeof(int32_t)) ? Load<int32_t>() : 0;
 }
 
 std::int16_t EMObsReaderBase::GetNextAsInt16()
 {
-    int16_t ret = 0;
-    int16_t* p = (int16_t*)&readBuffer[readPointer];
-
-    ret = *p;
-    readPointer += sizeof(int16_t);
-
-    return ret;
+    return Require(sizeof(int16_t)) ? Load<int16_t>() : 0;
 }
 
+/// <summary>
+/// Copy len bytes, the buffer is zeroed on a read error
+/// </summary>
 char* EMObsReaderBase::GetNextAsFixedChar(char* buffer, size_t len)
 {
-    memcpy(buffer, &readBuffer[readPointer], len);
-    readPointer += (long)len;
+    if (Require(len)) {
+        memcpy(buffer, &readBuffer[readPointer], len);
+        readPointer += (long)len;
+    }
+    else
+        memset(buffer, 0, len);
 
     return buffer;
 }
 
 float EMObsReaderBase::GetNextAsFloat() {
-    float ret = 0;
-    float* p = (float*)&readBuffer[readPointer];
-
-    ret = *p;
-    readPointer += sizeof(float);
-
-    return ret;
+    return Require(sizeof(float)) ? Load<float>() : 0;
 }
 
 double EMObsReaderBase::GetNextAsDouble()
 {
-    double ret = 0;
-    double* p = (double*)&readBuffer[readPointer];
-
-    ret = *p;
-    readPointer += sizeof(double);
-
-    return ret;
+    return Require(sizeof(double)) ? Load<double>() : 0;
 }
 
-std::vector<std::vector<std::wstring>> EMObsReaderBase::GetNextAsMAT()
+/// <summary>
+/// Read a MAT block. Only the offset of each cell is recorded (in the arena), the strings
+/// themselves are skipped over and stay in the file buffer
+/// </summary>
+EMObsMAT EMObsReaderBase::GetNextAsMAT(EMObsArena& arena)
 {
-    std::vector<std::vector<std::wstring>> ret;
+    EMObsMAT ret;
 
     // Check this is really a matrix 
     char szMAT[4];
     GetNextAsFixedChar(szMAT, 4);
 
-    if (strcmp(szMAT, "MAT") == 0) {
+    if (memcmp(szMAT, "MAT", 4) != 0) {
+        SetReadError();
+        return ret;
+    }
 
-        int32_t dimX = GetNextAsInt32();
-        int32_t dimY = GetNextAsInt32();
+    int32_t dimX = GetNextAsInt32();
+    int32_t dimY = GetNextAsInt32();
 
-        // Resize the vector to the desired dimensions
-        ret.resize(dimX);
-        for (auto& row : ret) {
-            row.resize(dimY);
-        }
+    if (dimX < 0 || dimY < 0 || (size_t)readPointer > readBufferSize) {
+        SetReadError();
+        return ret;
+    }
 
-        // Optionally, initialize with default values or perform operations
-        for (int y = 0; y < dimY; ++y) {
-            for (int x = 0; x < dimX; ++x) {
+    // An empty matrix has no cells
+    if (dimX == 0 || dimY == 0)
+        return ret;
 
+    // Each cell is at least a 4 byte length so a bad dimension can't allocate more than the file.
+    // Checked before multiplying, dimX * dimY can wrap a 32 bit size_t
+    if ((size_t)dimY > (readBufferSize - (size_t)readPointer) / sizeof(int32_t) / (size_t)dimX) {
+        SetReadError();
+        return ret;
+    }
+    size_t cells = (size_t)dimX * (size_t)dimY;
 
-                // Initialize each element or perform other operations
-                ret[x][y] = GetNextAsWString();
-            }
-        }
+    uint32_t* offsets = arena.NewArray<uint32_t>(cells);
+    if (offsets == nullptr) {
+        SetReadError();
+        return ret;
+    }
+
+    ret.buffer = readBuffer;
+    ret.dimX = dimX;
+    ret.dimY = dimY;
+    ret.offsets = offsets;
+
+    // Cells are stored in file order, y major
+    for (size_t i = 0; i < cells && !readError; i++) {
+        offsets[i] = (uint32_t)readPointer;
+        GetNextAsWStringView();
     }
 
+    if (readError)
+        ret = EMObsMAT();
+
     return ret;
 }
 
@@ -1517,6 +1653,86 @@ int EMObsReaderBase::GetNextTLC(void** p, int* size, char* TLC) {
 }
 
 
+/// <summary>
+/// Scan the whole buffer once, using the vectorised scanner selected by TLCScanSetMode(), and
+/// record the offset, TLC, version byte and length of every TLC
+/// </summary>
+/// <returns>0 if ok</returns>
+int EMObsReaderBase::BuildTLCIndex() {
+
+    tlcIndex.clear();
+
+    long pos = TLCScanFindNext(readBuffer, readBufferSize, 0);
+
+    while (pos != -1) {
+        struct _TLCIndexEntry entry;
+
+        entry.offset = (uint32_t)pos;
+        entry.length = 0;
+        memcpy(entry.cTLC, &readBuffer[pos], 3);
+        entry.cTLCVersion = (char)readBuffer[pos + 3];
+
+        if (!tlcIndex.empty())
+            tlcIndex.back().length = entry.offset - tlcIndex.back().offset;
+
+        tlcIndex.push_back(entry);
+
+        // A TLC can't overlap the next one (the version byte isn't a letter or digit)
+        pos = TLCScanFindNext(readBuffer, readBufferSize, pos + 4);
+    }
+
+    if (!tlcIndex.empty())
+        tlcIndex.back().length = (uint32_t)(readBufferSize - tlcIndex.back().offset);
+
+    tlcIndexBuilt = true;
+
+    return 0;
+}
+
+size_t EMObsReaderBase::GetTLCIndexCount() {
+
+    if (!tlcIndexBuilt)
+        BuildTLCIndex();
+
+    return tlcIndex.size();
+}
+
+/// <summary>
+/// Return the TLC index entry by ordinal (0 is the first TLC in the file)
+/// </summary>
+const struct _TLCIndexEntry* EMObsReaderBase::GetTLCIndexEntry(size_t ordinal) {
+
+    if (!tlcIndexBuilt)
+        BuildTLCIndex();
+
+    if (ordinal < tlcIndex.size())
+        return &tlcIndex[ordinal];
+    else
+        return nullptr;
+}
+
+/// <summary>
+/// Binary search the TLC index for the first TLC at or after offset
+/// </summary>
+/// <returns>Ordinal of the TLC or -1 if there are no more TLCs</returns>
+long EMObsReaderBase::FindTLCIndexByOffset(long offset) {
+
+    if (!tlcIndexBuilt)
+        BuildTLCIndex();
+
+    if (offset < 0)
+        offset = 0;
+
+    auto it = std::lower_bound(tlcIndex.begin(), tlcIndex.end(), (uint32_t)offset,
+        [](const struct _TLCIndexEntry& entry, uint32_t value) { return entry.offset < value; });
+
+    if (it != tlcIndex.end())
+        return (long)(it - tlcIndex.begin());
+    else
+        return -1;
+}
+
+
 long EMObsReaderBase::GetLastTLCSeekPointer() {
 
     return lastTLCSeekPointer;
@@ -1549,64 +1765,30 @@ void EMObsReaderBase::SetReadPointerToLastTLCSeekPointer() {
 
 }
 
+void EMObsReaderBase::SetReadPointer(long pointer) {
 
-long EMObsReaderBase::getFileSize(const std::string& fileName) {
-    std::ifstream file(fileName, std::ifstream::binary | std::ifstream::ate);
-
-    if (file) {
-        // Get the position of the file pointer
-        long fileSize = (long)file.tellg();
-        file.close();
-        return fileSize;
-    }
-    else {
-        std::cerr << "Could not open the file '" << fileName << "'" << std::endl;
-        return -1; // Error condition
-    }
-}
-
-
-bool EMObsReaderBase::readFileIntoBuffer(const std::string& fileName, unsigned char* buffer, size_t bufferSize) {
-    std::ifstream file(fileName, std::ifstream::binary);
-
-    if (!file) {
-        std::cerr << "Could not open the file '" << fileName << "'" << std::endl;
-        return false;
-    }
-
-    // Clear the buffer
-    std::memset(buffer, 0, bufferSize);
-
-    // Read the entire file into the buffer
-    file.read(reinterpret_cast<char*>(buffer), bufferSize);
-
-    if (!file) {
-        std::cerr << "Error occurred while reading the file" << std::endl;
-        return false;
-    }
-
-    file.close();
-    return true;
+    readPointer = pointer;
 }
 
 
-// Searches the buffer for a three letter code (TLC)
+// Searches the buffer for a three letter code (TLC) using the TLC index (built on the first call)
 // TLC should be declared as char TLC[4]
-// Return 0 if found or -1 if we have reached the end of the buffer
+// Return the offset of the TLC or -1 if we have reached the end of the buffer
 long EMObsReaderBase::findNextTLC(long startPointer, char* TLC) {
+
     long ret = -1;
-    long findPointer = startPointer;
-    bool found = false;
 
-    while (findPointer < readBufferSize && !found) {
+    if (!tlcIndexBuilt)
+        BuildTLCIndex();
 
-        if (IsTLC(findPointer, TLC)) {
-            ret = findPointer;
-            found = true;
-        }
-        else
-            findPointer++;
+    long ordinal = FindTLCIndexByOffset(startPointer);
+
+    if (ordinal != -1) {
+        const struct _TLCIndexEntry& entry = tlcIndex[ordinal];
 
+        memcpy(TLC, entry.cTLC, 3);
+        TLC[3] = '\0';
+        ret = (long)entry.offset;
     }
 
     return ret;
@@ -1675,18 +1857,22 @@ long EMObsReaderBase::FindNextwstring(int* wssize) {
         // So if we see a int32_t that is negative and less than -512 then we have found a wstring
         // Not perfect and we will miss any zero lenght wstrings because int32_t will be a too common
         // signature
-        int32_t* pws = (int32_t*)&this->pLast[i];
-        if (*pws < 0 && *pws > -512) {
-            int sizeFound = -(*pws);
+        int32_t ws;
+        memcpy(&ws, &this->pLast[i], sizeof(int32_t));
+        if (ws < 0 && ws > -512) {
+            int sizeFound = -ws;
 
-            // Check the supposed wstring is within the buffer range
-            if (i + sizeFound <= sizeLeft) {
+            // Check the supposed wstring is within the buffer range (and the file)
+            if (i + sizeFound <= sizeLeft &&
+                &this->pLast[i] + sizeof(int32_t) + sizeFound * sizeof(char16_t) <= readBuffer + readBufferSize) {
 
                 // Typically a wstring will be 2 bytes per character where only the first byte is used (also not perfect)
                 bool allOk = true;
-                int16_t* pwsInner = (int16_t*)&this->pLast[i + sizeof(int32_t)];
+                const unsigned char* pwsInner = &this->pLast[i + sizeof(int32_t)];
                 for (int j = 0; j < sizeFound; j++) {
-                    if (!(pwsInner[j] > 0 && pwsInner[j] < 256)) {
+                    int16_t wc;
+                    memcpy(&wc, &pwsInner[j * sizeof(int16_t)], sizeof(int16_t));
+                    if (!(wc > 0 && wc < 256)) {
                         allOk = false;
                         break;
                     }
@@ -1694,7 +1880,7 @@ long EMObsReaderBase::FindNextwstring(int* wssize) {
 
                 if (allOk) {
                     // We have found a wstring
-                    *wssize = (sizeFound * sizeof(wchar_t)) + sizeof(int32_t);
+                    *wssize = (sizeFound * sizeof(char16_t)) + sizeof(int32_t);
                     long ret = i + (long)(this->pLast - this->p);
                     this->pLast += i + *wssize;
 
@@ -1762,132 +1948,220 @@ int EMObsReaderBase::HexDumpLine(long seek, int dataLength, int widthToDisplay,
 
 
 
-int EMObsReader::ExtractTLCs(std::list<struct _OutputTLC*>& outputTLCsAdd) {
-    int ret = 0;
-    struct _EBS* pEBS = nullptr;
-    std::list<struct _IDA*> IDAList;
-    std::list<struct _CMS*> CMSList;    // List of 2 items max
-    struct _PER* pPER = nullptr;
-    std::list<struct _CCC*> CCCList;    // List of 2 items max
-    bool finished = false;
+/// <summary>
+/// Scan the file for the TLCs (the same candidates as the TLC index, in file order) and pass each
+/// one to the visitor as it is found. The FRAs are decoded in place for their camera and frame
+/// </summary>
+/// <returns>0 if ok</returns>
+int EMObsReader::ScanTLCs(EMObsTLCVisitor& visitor) {
 
-    ret = reader->ReadFile();
+    int ret = reader->ReadFile();
+    if (ret != 0)
+        return ret;
 
-    if (ret == 0) {
+    const unsigned char* buffer = reader->GetBuffer();
+    size_t size = reader->GetSize();
 
-        // Convert the filespec to a std::filesystem::path object
-        fs::path fullPath(filespec);
+    struct EMObsTLCItem item {};
+    item.row = 1;
 
-        // Extract the path (without the filename)
-        fs::path directoryPath = fullPath.parent_path();
+    long pos = TLCScanFindNext(buffer, size, 0);
 
-        // Extract the filename with extension
-        fs::path fileNameWithExtension = fullPath.filename();
+    while (pos != -1) {
+        item.seekOffset = pos;
+        memcpy(item.cTLC, &buffer[pos], 3);
+        item.cTLCVersion = (char)buffer[pos + 3];
+        item.hasFrame = false;
+
+        // Extract the data (development only)
+        if (EMObsTLC(item.cTLC) == EMObsSchema<_FRA>::tlc) {
+            struct _FRA FRA{};
 
+            reader->SetReadPointer(pos);
+            reader->ClearReadError();
+            if (DecodeRecord(&FRA) == DecodeOk) {
+                item.hasFrame = true;
+                item.iCameraZeroLeftOneRight = FRA.iCameraZeroLeftOneRight;
+                item.iFrameIndex = FRA.iFrameIndex;
+            }
+        }
 
+        if (!visitor.onTLC(item))
+            break;
+        item.row++;
 
-        int row = 1;
+        // A TLC can't overlap the next one (the version byte isn't a letter or digit)
+        pos = TLCScanFindNext(buffer, size, pos + 4);
+    }
 
-        unsigned char* p;
-        int size;
-        char TLC[4];
-        ret = reader->GetFirstTLC((void**)&p, &size, TLC);
+    return 0;
+}
 
-        while (ret == 0 && finished == false) {
-            unsigned char* pAfterTLC = (unsigned char*)(p + 3);
-            int fixedSize = size;
 
+int EMObsReader::ExtractTLCs(std::list<struct _OutputTLC*>& outputTLCsAdd) {
 
-            std::wstring wideTLC(TLC, TLC + 3);  // Copy first 3 characters
+    // Collects the TLCs into outputTLCsAdd
+    class ExtractTLCsVisitor : public EMObsTLCVisitor {
+    public:
+        ExtractTLCsVisitor(const std::string& filespec, std::list<struct _OutputTLC*>& _outputTLCsAdd) : outputTLCsAdd(_outputTLCsAdd) {
+            fs::path fullPath(filespec);
+            directoryPath = fullPath.parent_path().wstring();
+            fileNameWithExtension = fullPath.filename().wstring();
+        }
 
+        bool onTLC(const EMObsTLCItem& item) override {
             struct _OutputTLC* outputTLC = new struct _OutputTLC;
 
-            outputTLC->row = row++;
+            outputTLC->row = item.row;
             outputTLC->Path = directoryPath;
             outputTLC->File1 = fileNameWithExtension;
-            outputTLC->seekOffset = reader->GetLastTLCSeekPointer();
-            outputTLC->tlc = wideTLC;
-            outputTLC->cTLCByte = *pAfterTLC;
-
-            // Extract the data (development only)
-            if (outputTLC->tlc == L"FRA") {
-                reader->SetReadPointerToLastTLCSeekPointer();
-                struct _FRA* pFAR = GetFRA();
-
-                if (pFAR != nullptr) {
-                    outputTLC->data1 = std::to_wstring(pFAR->iCameraZeroLeftOneRight);
-                    outputTLC->data2 = std::to_wstring(pFAR->iFrameIndex);
-                }
+            outputTLC->seekOffset = item.seekOffset;
+            outputTLC->tlc = std::wstring(item.cTLC, item.cTLC + 3);
+            outputTLC->cTLCByte = item.cTLCVersion;
+            if (item.hasFrame) {
+                outputTLC->data1 = std::to_wstring(item.iCameraZeroLeftOneRight);
+                outputTLC->data2 = std::to_wstring(item.iFrameIndex);
             }
 
-
             outputTLCsAdd.push_back(outputTLC);
+            return true;
+        }
+
+    private:
+        std::list<struct _OutputTLC*>& outputTLCsAdd;
+        std::wstring directoryPath;
+        std::wstring fileNameWithExtension;
+    };
+
+    ExtractTLCsVisitor visitor(filespec, outputTLCsAdd);
+    return ScanTLCs(visitor);
+}
+
+
+#define HEXDUMP_CHUNK_SIZE (1024 * 1024)   // Bytes of the file formatted by one thread at a time
+
 
-            ret = reader->GetNextTLC((void**)&p, &size, TLC);
+/// <summary>
+/// Format the hex dump rows of data[start..end) and append them to out in the HexDumpLine layout
+/// (the address, the bytes in hex and as ASCII with '.' for anything not printable) with a form
+/// feed after every rowsPerPage rows of the file. start must be a multiple of rowWidth
+/// </summary>
+static void HexDumpRows(std::string& out, const unsigned char* data, size_t start, size_t end, int rowWidth, int rowsPerPage) {
+
+    static const char digits[] = "0123456789ABCDEF";
+
+    // The hex digits and the ASCII column character of each byte value
+    static const struct _HexDumpTables {
+        char hex[256][2];
+        char asc[256];
 
-            if (ret == -1) {
-                finished = true;
-                ret = 0;
+        _HexDumpTables() {
+            for (int b = 0; b < 256; b++) {
+                hex[b][0] = digits[b >> 4];
+                hex[b][1] = digits[b & 0xF];
+                asc[b] = (b < 0x20 || b > 0x7E) ? '.' : (char)b;
+            }
+        }
+    } tables;
+
+    std::vector<char> line(32 + (size_t)rowWidth * 4);
+    out.reserve(out.size() + ((end - start) / rowWidth + 1) * line.size());
+
+    for (size_t seek = start; seek < end; seek += rowWidth) {
+        size_t length = std::min((size_t)rowWidth, end - seek);
+        const unsigned char* bytes = data + seek;
+        char* p = line.data();
+
+        // Address, at least 8 digits
+        char address[16];
+        int count = 0;
+        size_t value = seek;
+        do {
+            address[15 - count++] = digits[value & 0xF];
+            value >>= 4;
+        } while (value != 0);
+        while (count < 8)
+            address[15 - count++] = '0';
+        memcpy(p, address + 16 - count, count);
+        p += count;
+
+        *p++ = ' ';
+        *p++ = ' ';
+        for (size_t i = 0; i < (size_t)rowWidth; i++) {
+            if (i > 0)
+                *p++ = ' ';
+            if (i < length) {
+                *p++ = tables.hex[bytes[i]][0];
+                *p++ = tables.hex[bytes[i]][1];
+            }
+            else {
+                *p++ = ' ';
+                *p++ = ' ';
             }
         }
-    }
 
+        *p++ = ' ';
+        *p++ = ' ';
+        for (size_t i = 0; i < (size_t)rowWidth; i++)
+            *p++ = i < length ? tables.asc[bytes[i]] : ' ';
+        *p++ = '\n';
 
-    // Clear
-    if (pEBS)
-        delete pEBS;
+        if (rowsPerPage > 0 && (seek / rowWidth + 1) % rowsPerPage == 0)
+            *p++ = '\f';
 
-    return ret;
+        out.append(line.data(), p - line.data());
+    }
 }
 
 
-int EMObsReader::HexDumpToFile(std::wofstream& outputFileStream, int rowWidth, int rowsPerPage) {
+/// <summary>
+/// Hex dump the whole file. The file is split into chunks of whole pages which are formatted on
+/// the threads set by SetThreads() (a wave of one chunk per thread at a time) and written in order
+/// </summary>
+/// <returns>0 if ok</returns>
+int EMObsReader::HexDumpToFile(EMObsUTF8Writer& outputFileStream, int rowWidth, int rowsPerPage) {
 
-    int ret = 0;
-    std::wstring address;
-    std::wstring hex;
-    std::wstring asc;
+    int ret = reader->ReadFile();
+    if (ret != 0)
+        return ret;
 
-    int row = 0;
-    int rows = 0;
-    int dataLength;
+    if (rowWidth <= 0)
+        return -1;
 
-    ret = reader->ReadFile();
+    const unsigned char* data = reader->GetBuffer();
+    size_t size = reader->GetSize();
 
-    if (ret == 0) {
-        size_t size = reader->GetSize();
+    size_t pageSize = (size_t)rowWidth * (size_t)std::max(rowsPerPage, 1);
+    size_t chunkSize = std::max<size_t>(1, HEXDUMP_CHUNK_SIZE / pageSize) * pageSize;
+    size_t chunks = (size + chunkSize - 1) / chunkSize;
 
-        for (long seek = 0; seek < size; seek += rowWidth) {
-            //not working
-            //            if (rows == 0) {
-            //                outputFileStream << L"Address  " << std::setw(widthToDisplay) << std::setfill(L' ') << L"Hexadecimal" << std::setw(widthToDisplay) << std::setfill(L' ') << L"ASCII" << std::endl;
-            //                outputFileStream << L"-------  " << std::setw(widthToDisplay) << std::setfill(L'-') << L"-----------" << std::setw(widthToDisplay) << std::setfill(L'-') << L"-----" << std::endl;
-            //            }
+    size_t threadCount = threads == 0 ? std::max(1u, std::thread::hardware_concurrency()) : threads;
+    threadCount = std::max<size_t>(1, std::min(threadCount, chunks));
 
-            if (size - seek < 16)
-                dataLength = (int)(size - (size_t)seek);
-            else
-                dataLength = rowWidth;
+    std::vector<std::string> formatted(threadCount);
 
+    for (size_t first = 0; first < chunks; first += threadCount) {
+        size_t wave = std::min(threadCount, chunks - first);
 
-            ret = reader->HexDumpLine(seek, dataLength, rowWidth, address, hex, asc);
-            if (ret == 0) {
-                outputFileStream << address << L"  " << hex << L"  " << asc << std::endl;
+        auto format = [&](size_t i) {
+            size_t start = (first + i) * chunkSize;
+            formatted[i].clear();
+            HexDumpRows(formatted[i], data, start, std::min(size, start + chunkSize), rowWidth, rowsPerPage);
+        };
 
-                row++;
-                rows++;
-                if (rows == rowsPerPage) {
-                    rows = 0;
-                    outputFileStream << L"\f";
-                }
-            }
-            else
-                outputFileStream << std::endl << L"Error from HexDumpLine = " << ret << " << std::endl";
-        }
-    }
+        std::vector<std::thread> threadList;
+        for (size_t i = 1; i < wave; i++)
+            threadList.emplace_back(format, i);
+        format(0);
 
-    return ret;
+        for (std::thread& thread : threadList)
+            thread.join();
+
+        for (size_t i = 0; i < wave; i++)
+            outputFileStream.Write(formatted[i].data(), formatted[i].size());
+    }
 
+    return 0;
 }
 
 
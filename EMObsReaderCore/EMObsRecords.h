@@ -0,0 +1,227 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "EMObsArena.h"
+
+// Decoded EMObs records. Strings and MAT cells are views into the file buffer and child records
+// live in the EMObsArena of the reader that decoded them, so a record is only valid while its
+// reader (and its buffer) is
+
+// Length prefixed UTF-16LE string inside the file buffer. The parse tree holds these rather than
+// copies, ToWString() makes an owned string at the output boundary
+struct EMObsWStringView {
+    const unsigned char* data = nullptr;    // UTF-16LE code units, not necessarily aligned
+    int32_t length = 0;                     // Length in UTF-16 code units
+
+    bool empty() const { return length == 0; }
+    size_t size() const { return (size_t)length; }
+
+    char16_t at(size_t i) const {
+        char16_t c;
+        memcpy(&c, data + (i * sizeof(char16_t)), sizeof(char16_t));
+        return c;
+    }
+
+    std::wstring ToWString() const;
+};
+
+
+// MAT block: a dimX by dimY table of strings. Rather than a vector of vectors of strings the
+// cells are kept as one flat array of buffer offsets (in file order, y major) and the cell views
+// are made on demand
+struct EMObsMAT {
+    const unsigned char* buffer = nullptr;  // Start of the file buffer
+    int32_t dimX = 0;
+    int32_t dimY = 0;
+    const uint32_t* offsets = nullptr;      // Offset of each cell's length prefix (in the arena)
+
+    int32_t GetDimX() const { return dimX; }
+    int32_t GetDimY() const { return dimY; }
+
+    // Empty view if x,y is out of range
+    EMObsWStringView cell(int32_t x, int32_t y) const;
+
+    // 0 if ok, -1 if the cell is empty (or out of range), -2 if not a number
+    int AsInt(int32_t x, int32_t y, int32_t* value) const;
+};
+
+
+//#pragma pack(push, 1) // Save the current alignment setting and set alignment to 1 byte
+
+// EBS and children
+struct _EBS {
+    long fileSeekPointer;
+    char cTLC[3];
+    char cTLCVersion;                   // Seen 4 and 5 but no cheange in the data
+    EMObsWStringView wsPictureDirectory;
+
+    struct _CIN* pCIN;                  // Holds the opcode data
+    struct _PTN* pPTN;                  // Holds the input field titles
+};
+struct _CIN {   // Holds the opcode data
+    long fileSeekPointer;
+    char cTLC[3]{};
+    char cTLCVersion;
+
+    EMObsMAT matTitle;
+    EMObsMAT matValue;
+};
+struct _PTN {   // Holds the input field titles
+    long fileSeekPointer;
+    char cTLC[3];
+    char cTLCVersion;
+    EMObsMAT matCollectionHeadings;
+    int32_t iData1;	    // seen as 86  
+};
+
+// IDA and children
+// FRA is used to hold a left/right camera indicator, a frame number and a media file (MP4)
+// The character after this TLC is always ASCII 0x01
+// This is a variable length structure 
+struct _FRA {
+    long fileSeekPointer;
+    char cTLC[3];
+    char cTLCVersion;
+
+    int32_t iCameraZeroLeftOneRight;
+    int32_t iFrameIndex;
+    EMObsWStringView wsMediaFile;
+};
+
+// CPT is used to hold an X,Y position on a frame
+// The character after this TLC is always ASCII 0x00
+// This is a fixed length structure of 16 bytes (2x double)
+// Only the coordinates are kept, CPTs are always stored inline in their parent record
+struct _CPT {
+    double X;
+    double Y;
+};
+
+// IDA is used to hold arrays of 3D Measurement Points (PDL), 3D Points (PD3) and Points (PDA)
+// The character after this TLC is always ASCII 0x05
+// This is a variable length structure 
+// If always starts with an FRA
+
+struct _IDA {
+    long fileSeekPointer;
+    char cTLC[3];
+    char cTLCVersion;
+
+    struct _FRA FRA;
+
+    // 2D Point Array
+    struct {
+        int32_t iPDACount;
+        EMObsArenaArray<struct _PDA*> PDAList;    // In the arena
+
+    } TypePDA;
+
+#pragma pack(push, 1)
+    union {
+        char bData[16];
+        int32_t ints[4];
+        double doubles[2];
+    } data1;
+#pragma pack(pop)
+    EMObsWStringView wsPeriodName;
+
+    // 3D Measurement Point Array
+    struct {
+        int32_t iPDLCount;
+        EMObsArenaArray<struct _PDL*> PDLList;    // In the arena
+    } TypePDL;
+
+    // 3D Point Array
+    struct {
+        int32_t iPD3Count;
+        EMObsArenaArray<struct _PD3*> PD3List;    // In the arena
+    } TypePD3;
+
+#pragma pack(push, 1)
+    union {
+        char bData[16];
+        int32_t ints[4];
+    } data2;
+#pragma pack(pop)
+};
+
+// PDA is used to hold a single 2D Point in a left or right camera frame
+// The character after this TLC is always ASCII 0x01
+// This is a variable length structure 
+// PDL is exclusively a child of IDA
+struct _PDA {       // Beleive to indicate a Point in a frame
+    long fileSeekPointer;
+    char cTLC[3];
+    char cTLCVersion;    // Seen 0 and 1, 1 has an additional 16 bytes of unknown data are the MAT
+
+    struct _CPT CPT;
+    EMObsMAT matCollectionValues;
+
+    char bData[16];		 // Not used in verion 0
+};
+
+// PDL is used to hold a 3D measurement point i.e. 2x3D points in the left camera frame and 2x3D points in the right camera frame
+// The character after this TLC is always ASCII 0x01
+// This is a variable length structure 
+// PDL is exclusively a child of IDA
+struct _PDL {
+    long fileSeekPointer;
+    char cTLC[3];
+    char cTLCVersion;
+
+    int32_t iData1;	    // seen 2
+    int32_t iData2;	    // seen 2  (stored between CPT2 and CPT3 in the file)
+
+    // The coordinates and right camera frame are inline so the whole record is one block
+    struct _CPT CPT1;
+    struct _CPT CPT2;
+    struct _CPT CPT3;
+    struct _CPT CPT4;
+    struct _FRA FRA;
+    EMObsMAT matCollectionValues;
+};
+
+// PD3 is used to hold a single 3D Point in a left or right camera frame
+// The character after this TLC is always ASCII 0x00 (different to PDA and PDL)
+// This is a variable length structure 
+// PD3 is exclusively a child of IDA
+struct _PD3 {
+    long fileSeekPointer;
+    char cTLC[3];
+    char cTLCVersion;
+
+    struct _CPT CPT1;
+    struct _CPT CPT2;
+    struct _FRA FRA;
+    EMObsMAT matCollectionValues;
+};
+
+
+// CMS and children
+struct _CMS {
+    long fileSeekPointer;
+    char cTLC[3];
+    char cTLCVersion;
+
+};
+
+// PER and children
+struct _PER {
+    long fileSeekPointer;
+    char cTLC[3];
+    char cTLCVersion;
+
+};
+
+// CCC and children
+struct _CCC {
+    long fileSeekPointer;
+    char cTLC[3];
+    char cTLCVersion;
+
+};
+
+//#pragma pack(pop) // Restore the previous alignment setting
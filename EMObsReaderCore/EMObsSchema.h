@@ -0,0 +1,314 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "EMObsRecords.h"
+
+// Compile-time description of the EMObs records. Each record type has an EMObsSchema
+// specialisation giving its TLC and, for every version the reader understands, its fields in file
+// order. The EMObsReader decoders are generated from these (see EMObsReader::DecodeRecord), so a
+// new version of a record is a new EMObsVersion entry rather than a new Get function
+
+
+// 24 bit value of a TLC, the three letters as a little endian integer i.e. the low three bytes of
+// the TLC and version loaded as one uint32_t. Usable as a case label
+constexpr uint32_t EMObsTLC(const char* tlc) {
+    return (uint32_t)(unsigned char)tlc[0] |
+        ((uint32_t)(unsigned char)tlc[1] << 8) |
+        ((uint32_t)(unsigned char)tlc[2] << 16);
+}
+
+
+// A field of a record. How it is decoded follows from the type of the member:
+//   int32_t                            4 bytes
+//   EMObsWStringView                   length prefixed UTF-16 string
+//   EMObsMAT                           MAT block
+//   a record (_CPT, _FRA)              nested record with its own TLC
+//   a record pointer (_CIN*, _PTN*)    as above, allocated in the arena
+//   struct { int32_t; EMObsArenaArray<record*> }   a count followed by that many records
+//   anything else (double, char[16])   raw bytes, sizeof the member
+enum EMObsFieldFlags {
+    EMObsFieldRequired = 0,
+    EMObsFieldOptional = 1,     // A bad field is reported and left zeroed, the record carries on
+    EMObsFieldExpect = 2        // int32_t only, warn if it isn't Expected
+};
+
+template <typename M>
+struct EMObsMemberTraits;
+template <typename R, typename T>
+struct EMObsMemberTraits<T R::*> {
+    using Record = R;
+    using Type = T;
+};
+
+template <auto Member, int Flags = EMObsFieldRequired, int32_t Expected = 0>
+struct EMObsField {
+    using Type = typename EMObsMemberTraits<decltype(Member)>::Type;
+    static constexpr auto member = Member;
+    static constexpr int flags = Flags;
+    static constexpr int32_t expected = Expected;
+};
+
+template <typename Record>
+struct EMObsSchema;     // Specialised below for each record
+
+
+// true for a type with an EMObsSchema
+template <typename T, typename = void>
+struct EMObsIsRecord : std::false_type {};
+template <typename T>
+struct EMObsIsRecord<T, std::void_t<decltype(EMObsSchema<T>::tlc)>> : std::true_type {};
+
+// true for a record that keeps its own offset, TLC and version (all but _CPT)
+template <typename T, typename = void>
+struct EMObsHasHeader : std::false_type {};
+template <typename T>
+struct EMObsHasHeader<T, std::void_t<decltype(&T::cTLCVersion), decltype(&T::fileSeekPointer)>> : std::true_type {};
+
+
+// Smallest number of bytes a field can take in the file
+template <typename T>
+constexpr size_t EMObsMinSize() {
+    if constexpr (std::is_same<T, int32_t>::value || std::is_same<T, EMObsWStringView>::value)
+        return sizeof(int32_t);
+    else if constexpr (EMObsIsRecord<T>::value)
+        return EMObsSchema<T>::minSize;
+    else if constexpr (std::is_pointer<T>::value)
+        return EMObsSchema<std::remove_pointer_t<T>>::minSize;
+    else if constexpr (std::is_class<T>::value && !std::is_union<T>::value)
+        return sizeof(int32_t);         // A list, just the count
+    else
+        return sizeof(T);
+}
+
+// An optional field counts for nothing, a record may still decode without it
+template <typename Field>
+constexpr size_t EMObsFieldMinSize() {
+    return (Field::flags & EMObsFieldOptional) != 0 ? 0 : EMObsMinSize<typename Field::Type>();
+}
+
+// true for a field that always takes the same number of bytes (defined below)
+template <typename T>
+constexpr bool EMObsIsFixedSize();
+
+// Number of required fields at the start of a list that take a fixed number of bytes
+template <typename... Fields>
+constexpr size_t EMObsFixedFields() {
+    constexpr bool fixed[] = { (EMObsIsFixedSize<typename Fields::Type>() && (Fields::flags & EMObsFieldOptional) == 0)..., false };
+    size_t n = 0;
+    while (fixed[n])
+        n++;
+    return n;
+}
+
+
+// One version of a record, the TLC and version byte followed by Fields. Once minSize bytes are
+// known to be there the first fixedFields fields can be loaded without a check
+template <char Version, typename... Fields>
+struct EMObsVersion {
+    static constexpr char version = Version;
+    static constexpr size_t minSize = (sizeof(uint32_t) + ... + EMObsFieldMinSize<Fields>());
+    static constexpr size_t fieldCount = sizeof...(Fields);
+    static constexpr size_t fixedFields = EMObsFixedFields<Fields...>();
+    static constexpr bool fixedSize = fixedFields == fieldCount;
+};
+
+template <typename... Versions>
+struct EMObsVersions {
+    static constexpr size_t count = sizeof...(Versions);
+    static constexpr size_t minSize = std::min({ Versions::minSize... });
+    static constexpr bool fixedSize = count == 1 && (Versions::fixedSize && ...);
+};
+
+// int32_t, raw bytes and records with a single version of fixed size fields (_CPT)
+template <typename T>
+constexpr bool EMObsIsFixedSize() {
+    if constexpr (std::is_same<T, int32_t>::value)
+        return true;
+    else if constexpr (std::is_same<T, EMObsWStringView>::value || std::is_same<T, EMObsMAT>::value || std::is_pointer<T>::value)
+        return false;
+    else if constexpr (EMObsIsRecord<T>::value)
+        return EMObsSchema<T>::Versions::fixedSize;
+    else if constexpr (std::is_class<T>::value && !std::is_union<T>::value)
+        return false;                   // A list
+    else
+        return true;
+}
+
+
+// Records. Children are listed before their parents, a parent's minimum size includes theirs.
+// keepPartial records (the ones the walk decodes) are still returned if a field fails part way
+// through, the walk then reports the read error
+
+// Coordinate point
+template <> struct EMObsSchema<_CPT> {
+    static constexpr const char* name = "CPT";
+    static constexpr uint32_t tlc = EMObsTLC("CPT");
+    static constexpr bool keepPartial = false;
+    using Versions = EMObsVersions<
+        EMObsVersion<0, EMObsField<&_CPT::X>, EMObsField<&_CPT::Y>>>;
+    static constexpr size_t minSize = Versions::minSize;
+};
+
+// Frame: left/right camera, frame number and media file
+template <> struct EMObsSchema<_FRA> {
+    static constexpr const char* name = "FRA";
+    static constexpr uint32_t tlc = EMObsTLC("FRA");
+    static constexpr bool keepPartial = false;
+    using Versions = EMObsVersions<
+        EMObsVersion<1, EMObsField<&_FRA::iCameraZeroLeftOneRight>, EMObsField<&_FRA::iFrameIndex>, EMObsField<&_FRA::wsMediaFile>>>;
+    static constexpr size_t minSize = Versions::minSize;
+};
+
+// MAT block header, the cells are read by EMObsReaderBase::GetNextAsMAT
+template <> struct EMObsSchema<EMObsMAT> {
+    static constexpr const char* name = "MAT";
+    static constexpr uint32_t tlc = EMObsTLC("MAT");
+    static constexpr bool keepPartial = false;
+    using Versions = EMObsVersions<
+        EMObsVersion<0, EMObsField<&EMObsMAT::dimX>, EMObsField<&EMObsMAT::dimY>>>;
+    static constexpr size_t minSize = Versions::minSize;
+};
+
+// Information fields (opcode data)
+template <> struct EMObsSchema<_CIN> {
+    static constexpr const char* name = "CIN";
+    static constexpr uint32_t tlc = EMObsTLC("CIN");
+    static constexpr bool keepPartial = false;
+    using Versions = EMObsVersions<
+        EMObsVersion<0, EMObsField<&_CIN::matTitle>, EMObsField<&_CIN::matValue>>>;
+    static constexpr size_t minSize = Versions::minSize;
+};
+
+// Collection field titles
+template <> struct EMObsSchema<_PTN> {
+    static constexpr const char* name = "PTN";
+    static constexpr uint32_t tlc = EMObsTLC("PTN");
+    static constexpr bool keepPartial = false;
+    using Versions = EMObsVersions<
+        EMObsVersion<0, EMObsField<&_PTN::matCollectionHeadings>, EMObsField<&_PTN::iData1>>>;
+    static constexpr size_t minSize = Versions::minSize;
+};
+
+// File header, version 4 and 5 have the same fields
+template <> struct EMObsSchema<_EBS> {
+    static constexpr const char* name = "EBS";
+    static constexpr uint32_t tlc = EMObsTLC("EBS");
+    static constexpr bool keepPartial = true;
+    using Versions = EMObsVersions<
+        EMObsVersion<4, EMObsField<&_EBS::wsPictureDirectory>, EMObsField<&_EBS::pCIN, EMObsFieldOptional>, EMObsField<&_EBS::pPTN, EMObsFieldOptional>>,
+        EMObsVersion<5, EMObsField<&_EBS::wsPictureDirectory>, EMObsField<&_EBS::pCIN, EMObsFieldOptional>, EMObsField<&_EBS::pPTN, EMObsFieldOptional>>>;
+    static constexpr size_t minSize = Versions::minSize;
+};
+
+// 2D point, version 1 has 16 bytes of unknown data after the MAT
+template <> struct EMObsSchema<_PDA> {
+    static constexpr const char* name = "PDA";
+    static constexpr uint32_t tlc = EMObsTLC("PDA");
+    static constexpr bool keepPartial = false;
+    using Versions = EMObsVersions<
+        EMObsVersion<0, EMObsField<&_PDA::CPT>, EMObsField<&_PDA::matCollectionValues>>,
+        EMObsVersion<1, EMObsField<&_PDA::CPT>, EMObsField<&_PDA::matCollectionValues>, EMObsField<&_PDA::bData>>>;
+    static constexpr size_t minSize = Versions::minSize;
+};
+
+// 3D measurement, the two counts have only been seen as 2
+template <> struct EMObsSchema<_PDL> {
+    static constexpr const char* name = "PDL";
+    static constexpr uint32_t tlc = EMObsTLC("PDL");
+    static constexpr bool keepPartial = false;
+    using Versions = EMObsVersions<
+        EMObsVersion<1,
+            EMObsField<&_PDL::iData1, EMObsFieldExpect, 2>, EMObsField<&_PDL::CPT1>, EMObsField<&_PDL::CPT2>,
+            EMObsField<&_PDL::iData2, EMObsFieldExpect, 2>, EMObsField<&_PDL::CPT3>, EMObsField<&_PDL::CPT4>,
+            EMObsField<&_PDL::FRA>, EMObsField<&_PDL::matCollectionValues>>>;
+    static constexpr size_t minSize = Versions::minSize;
+};
+
+// 3D point
+template <> struct EMObsSchema<_PD3> {
+    static constexpr const char* name = "PD3";
+    static constexpr uint32_t tlc = EMObsTLC("PD3");
+    static constexpr bool keepPartial = false;
+    using Versions = EMObsVersions<
+        EMObsVersion<0, EMObsField<&_PD3::CPT1>, EMObsField<&_PD3::CPT2>, EMObsField<&_PD3::FRA>, EMObsField<&_PD3::matCollectionValues>>>;
+    static constexpr size_t minSize = Versions::minSize;
+};
+
+// Measurement data. A bad FRA is reported and left zeroed
+template <> struct EMObsSchema<_IDA> {
+    static constexpr const char* name = "IDA";
+    static constexpr uint32_t tlc = EMObsTLC("IDA");
+    static constexpr bool keepPartial = true;
+    using Versions = EMObsVersions<
+        EMObsVersion<5,
+            EMObsField<&_IDA::FRA, EMObsFieldOptional>, EMObsField<&_IDA::TypePDA>, EMObsField<&_IDA::data1>,
+            EMObsField<&_IDA::wsPeriodName>, EMObsField<&_IDA::TypePDL>, EMObsField<&_IDA::TypePD3>,
+            EMObsField<&_IDA::data2>>>;
+    static constexpr size_t minSize = Versions::minSize;
+};
+
+// The records after the measurements, their contents are not known yet
+template <> struct EMObsSchema<_CMS> {
+    static constexpr const char* name = "CMS";
+    static constexpr uint32_t tlc = EMObsTLC("CMS");
+    static constexpr bool keepPartial = false;
+    using Versions = EMObsVersions<EMObsVersion<1>>;
+    static constexpr size_t minSize = Versions::minSize;
+};
+
+template <> struct EMObsSchema<_PER> {
+    static constexpr const char* name = "PER";
+    static constexpr uint32_t tlc = EMObsTLC("PER");
+    static constexpr bool keepPartial = false;
+    using Versions = EMObsVersions<EMObsVersion<0>>;
+    static constexpr size_t minSize = Versions::minSize;
+};
+
+template <> struct EMObsSchema<_CCC> {
+    static constexpr const char* name = "CCC";
+    static constexpr uint32_t tlc = EMObsTLC("CCC");
+    static constexpr bool keepPartial = false;
+    using Versions = EMObsVersions<EMObsVersion<0>>;
+    static constexpr size_t minSize = Versions::minSize;
+};
+
+
+// Run time view of the schema, one entry per TLC and version
+struct EMObsRecordInfo {
+    uint32_t tlc;
+    const char* name;
+    char version;
+};
+
+template <typename... Records>
+struct EMObsSchemaTable {
+    static constexpr size_t count = (EMObsSchema<Records>::Versions::count + ...);
+
+    static constexpr std::array<EMObsRecordInfo, count> Build() {
+        std::array<EMObsRecordInfo, count> table{};
+        size_t n = 0;
+        (Add<Records>(table, n, typename EMObsSchema<Records>::Versions()), ...);
+        return table;
+    }
+
+private:
+    template <typename Record, typename... Versions>
+    static constexpr void Add(std::array<EMObsRecordInfo, count>& table, size_t& n, EMObsVersions<Versions...>) {
+        ((table[n++] = EMObsRecordInfo{ EMObsSchema<Record>::tlc, EMObsSchema<Record>::name, Versions::version }), ...);
+    }
+};
+
+inline constexpr auto emobsRecordTable = EMObsSchemaTable<
+    _EBS, _CIN, _PTN, EMObsMAT, _IDA, _FRA, _PDA, _PDL, _PD3, _CPT, _CMS, _PER, _CCC>::Build();
+
+
+// The entry for a TLC and version, nullptr if the reader doesn't know it
+const EMObsRecordInfo* EMObsFindRecordInfo(uint32_t tlc, char version);
+
+// true if any version of the TLC is known
+bool EMObsIsKnownTLC(uint32_t tlc);
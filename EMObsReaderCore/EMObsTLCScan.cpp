@@ -0,0 +1,281 @@
+// EMObsTLCScan.cpp : Vectorised three letter code (TLC) scanner with a scalar fallback.
+//
+
+#include "pch.h"
+#include "framework.h"
+
+#include <atomic>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TLCSCAN_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TLCSCAN_TARGET(x) __attribute__((target(x)))
+#else
+#define TLCSCAN_TARGET(x)
+#endif
+
+#include "EMObsTLCScan.h"
+
+
+static std::atomic<int> scanMode{ (int)TLCScanMode::Auto };
+
+
+static inline bool IsTLCAt(const unsigned char* p) {
+    return isupper(p[0]) &&
+        (isupper(p[1]) || isdigit(p[1])) &&
+        (isupper(p[2]) || isdigit(p[2])) &&
+        p[3] <= 5;
+}
+
+static inline int LowestBit(uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+
+/// <summary>
+/// The original byte at a time loop
+/// </summary>
+static long FindNextScalar(const unsigned char* buffer, size_t size, size_t start) {
+
+    for (size_t i = start; i + 3 < size; i++) {
+        if (IsTLCAt(&buffer[i]))
+            return (long)i;
+    }
+
+    return -1;
+}
+
+
+#ifdef TLCSCAN_X86
+
+// The byte classes are range checks done as a signed compare after biasing the byte so the
+// range starts at -128 i.e. (b - low) < count  becomes  (b - low - 128) < (count - 128)
+#define TLCSCAN_RANGE(v, low, count, add, cmplt, set1) \
+    cmplt(add(v, set1((char)(0x80 - (low)))), set1((char)((count) - 128)))
+
+TLCSCAN_TARGET("sse2")
+uint32_t TLCScanMaskSSE2(const unsigned char* p) {
+
+    __m128i v0 = _mm_loadu_si128((const __m128i*)(p + 0));
+    __m128i v1 = _mm_loadu_si128((const __m128i*)(p + 1));
+    __m128i v2 = _mm_loadu_si128((const __m128i*)(p + 2));
+    __m128i v3 = _mm_loadu_si128((const __m128i*)(p + 3));
+
+    __m128i c0 = TLCSCAN_RANGE(v0, 'A', 26, _mm_add_epi8, _mm_cmplt_epi8, _mm_set1_epi8);
+    __m128i c1 = _mm_or_si128(TLCSCAN_RANGE(v1, 'A', 26, _mm_add_epi8, _mm_cmplt_epi8, _mm_set1_epi8),
+        TLCSCAN_RANGE(v1, '0', 10, _mm_add_epi8, _mm_cmplt_epi8, _mm_set1_epi8));
+    __m128i c2 = _mm_or_si128(TLCSCAN_RANGE(v2, 'A', 26, _mm_add_epi8, _mm_cmplt_epi8, _mm_set1_epi8),
+        TLCSCAN_RANGE(v2, '0', 10, _mm_add_epi8, _mm_cmplt_epi8, _mm_set1_epi8));
+    __m128i c3 = TLCSCAN_RANGE(v3, 0, 6, _mm_add_epi8, _mm_cmplt_epi8, _mm_set1_epi8);
+
+    __m128i all = _mm_and_si128(_mm_and_si128(c0, c1), _mm_and_si128(c2, c3));
+
+    return (uint32_t)_mm_movemask_epi8(all);
+}
+
+// AVX2 has no signed less than, so use greater than with the arguments swapped
+#define TLCSCAN_CMPLT256(a, b) _mm256_cmpgt_epi8(b, a)
+
+TLCSCAN_TARGET("avx2")
+uint32_t TLCScanMaskAVX2(const unsigned char* p) {
+
+    __m256i v0 = _mm256_loadu_si256((const __m256i*)(p + 0));
+    __m256i v1 = _mm256_loadu_si256((const __m256i*)(p + 1));
+    __m256i v2 = _mm256_loadu_si256((const __m256i*)(p + 2));
+    __m256i v3 = _mm256_loadu_si256((const __m256i*)(p + 3));
+
+    __m256i c0 = TLCSCAN_RANGE(v0, 'A', 26, _mm256_add_epi8, TLCSCAN_CMPLT256, _mm256_set1_epi8);
+    __m256i c1 = _mm256_or_si256(TLCSCAN_RANGE(v1, 'A', 26, _mm256_add_epi8, TLCSCAN_CMPLT256, _mm256_set1_epi8),
+        TLCSCAN_RANGE(v1, '0', 10, _mm256_add_epi8, TLCSCAN_CMPLT256, _mm256_set1_epi8));
+    __m256i c2 = _mm256_or_si256(TLCSCAN_RANGE(v2, 'A', 26, _mm256_add_epi8, TLCSCAN_CMPLT256, _mm256_set1_epi8),
+        TLCSCAN_RANGE(v2, '0', 10, _mm256_add_epi8, TLCSCAN_CMPLT256, _mm256_set1_epi8));
+    __m256i c3 = TLCSCAN_RANGE(v3, 0, 6, _mm256_add_epi8, TLCSCAN_CMPLT256, _mm256_set1_epi8);
+
+    __m256i all = _mm256_and_si256(_mm256_and_si256(c0, c1), _mm256_and_si256(c2, c3));
+
+    return (uint32_t)_mm256_movemask_epi8(all);
+}
+
+/// <summary>
+/// Scan whole blocks of 16 (or 32) positions and finish the tail, where a full block plus the 3
+/// byte look ahead no longer fits, with the scalar loop
+/// </summary>
+TLCSCAN_TARGET("sse2")
+static long FindNextSSE2(const unsigned char* buffer, size_t size, size_t start) {
+
+    size_t i = start;
+
+    if (size >= 16 + 3) {
+        for (size_t last = size - (16 + 3); i <= last; i += 16) {
+            uint32_t mask = TLCScanMaskSSE2(&buffer[i]);
+            if (mask != 0)
+                return (long)(i + LowestBit(mask));
+        }
+    }
+
+    return FindNextScalar(buffer, size, i);
+}
+
+TLCSCAN_TARGET("avx2")
+static long FindNextAVX2(const unsigned char* buffer, size_t size, size_t start) {
+
+    size_t i = start;
+
+    if (size >= 32 + 3) {
+        for (size_t last = size - (32 + 3); i <= last; i += 32) {
+            uint32_t mask = TLCScanMaskAVX2(&buffer[i]);
+            if (mask != 0)
+                return (long)(i + LowestBit(mask));
+        }
+    }
+
+    return FindNextScalar(buffer, size, i);
+}
+
+static bool CPUHasAVX2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+
+    // The OS must also save the YMM registers (OSXSAVE and XCR0 bits 1 and 2)
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+        return false;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#else
+
+// Portable versions of the block classifiers for non x86 builds
+uint32_t TLCScanMaskSSE2(const unsigned char* p) {
+    uint32_t mask = 0;
+    for (int i = 0; i < 16; i++) {
+        if (IsTLCAt(p + i))
+            mask |= 1u << i;
+    }
+    return mask;
+}
+
+uint32_t TLCScanMaskAVX2(const unsigned char* p) {
+    uint32_t mask = 0;
+    for (int i = 0; i < 32; i++) {
+        if (IsTLCAt(p + i))
+            mask |= 1u << i;
+    }
+    return mask;
+}
+
+#endif
+
+
+bool TLCScanIsSupported(TLCScanMode mode) {
+
+    switch (mode) {
+    case TLCScanMode::Auto:
+    case TLCScanMode::Scalar:
+        return true;
+#ifdef TLCSCAN_X86
+    case TLCScanMode::SSE2:
+        return true;
+    case TLCScanMode::AVX2: {
+        static const bool hasAVX2 = CPUHasAVX2();
+        return hasAVX2;
+    }
+#endif
+    default:
+        return false;
+    }
+}
+
+/// <summary>
+/// Select the scanner. Auto or an unsupported mode picks the fastest supported scanner
+/// </summary>
+/// <returns>The scanner now in use</returns>
+TLCScanMode TLCScanSetMode(TLCScanMode mode) {
+
+    if (mode == TLCScanMode::Auto || !TLCScanIsSupported(mode)) {
+        if (TLCScanIsSupported(TLCScanMode::AVX2))
+            mode = TLCScanMode::AVX2;
+        else if (TLCScanIsSupported(TLCScanMode::SSE2))
+            mode = TLCScanMode::SSE2;
+        else
+            mode = TLCScanMode::Scalar;
+    }
+
+    scanMode = (int)mode;
+
+    return mode;
+}
+
+TLCScanMode TLCScanGetMode() {
+
+    TLCScanMode mode = (TLCScanMode)scanMode.load();
+
+    if (mode == TLCScanMode::Auto)
+        mode = TLCScanSetMode(TLCScanMode::Auto);
+
+    return mode;
+}
+
+const char* TLCScanModeName(TLCScanMode mode) {
+
+    switch (mode) {
+    case TLCScanMode::Auto:
+        return "Auto";
+    case TLCScanMode::Scalar:
+        return "Scalar";
+    case TLCScanMode::SSE2:
+        return "SSE2";
+    case TLCScanMode::AVX2:
+        return "AVX2";
+    default:
+        return "Unknown";
+    }
+}
+
+
+long TLCScanFindNext(const unsigned char* buffer, size_t size, long startPointer) {
+
+    return TLCScanFindNext(buffer, size, startPointer, TLCScanGetMode());
+}
+
+long TLCScanFindNext(const unsigned char* buffer, size_t size, long startPointer, TLCScanMode mode) {
+
+    if (buffer == nullptr || startPointer < 0 || (size_t)startPointer >= size)
+        return -1;
+
+    if (mode == TLCScanMode::Auto || !TLCScanIsSupported(mode))
+        mode = TLCScanGetMode();
+
+    switch (mode) {
+#ifdef TLCSCAN_X86
+    case TLCScanMode::SSE2:
+        return FindNextSSE2(buffer, size, (size_t)startPointer);
+    case TLCScanMode::AVX2:
+        return FindNextAVX2(buffer, size, (size_t)startPointer);
+#endif
+    default:
+        return FindNextScalar(buffer, size, (size_t)startPointer);
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+// Three letter code (TLC) scanner used by EMObsReaderBase::findNextTLC
+// A TLC candidate is an upper case letter, followed by two upper case letters or digits, followed
+// by a version byte in the range 0 to 5 (the same test as EMObsReaderBase::IsTLC)
+enum class TLCScanMode {
+    Auto,       // Fastest scanner supported by this CPU
+    Scalar,     // One byte at a time (the original findNextTLC loop)
+    SSE2,       // 16 positions at a time
+    AVX2        // 32 positions at a time
+};
+
+
+// Scanner selection (process wide, defaults to Auto)
+bool TLCScanIsSupported(TLCScanMode mode);
+TLCScanMode TLCScanSetMode(TLCScanMode mode);
+TLCScanMode TLCScanGetMode();
+const char* TLCScanModeName(TLCScanMode mode);
+
+// Return the offset of the first TLC candidate at or after startPointer or -1 if there are none
+long TLCScanFindNext(const unsigned char* buffer, size_t size, long startPointer);
+long TLCScanFindNext(const unsigned char* buffer, size_t size, long startPointer, TLCScanMode mode);
+
+// Classify the positions p[0..15] (SSE2) or p[0..31] (AVX2) and return the TLC candidates as a
+// bitmask, bit n set means a TLC starts at p[n]. The caller must make sure 3 bytes past the
+// block are readable
+uint32_t TLCScanMaskSSE2(const unsigned char* p);
+uint32_t TLCScanMaskAVX2(const unsigned char* p);
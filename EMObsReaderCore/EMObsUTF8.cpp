@@ -0,0 +1,282 @@
+// EMObsUTF8.cpp : UTF-8 conversion and the UTF-8 output file writer.
+//
+
+#include "pch.h"
+#include "framework.h"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define UTF8_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "EMObsUTF8.h"
+
+
+#define UTF8_BLOCK_SIZE (1024 * 1024)   // Bytes buffered by EMObsUTF8Writer before they are written
+#define UTF8_REPLACEMENT 0xFFFD
+
+
+static inline char* EncodeUTF8(char* p, uint32_t c) {
+
+    if (c < 0x80) {
+        *p++ = (char)c;
+    }
+    else if (c < 0x800) {
+        *p++ = (char)(0xC0 | (c >> 6));
+        *p++ = (char)(0x80 | (c & 0x3F));
+    }
+    else if (c < 0x10000) {
+        *p++ = (char)(0xE0 | (c >> 12));
+        *p++ = (char)(0x80 | ((c >> 6) & 0x3F));
+        *p++ = (char)(0x80 | (c & 0x3F));
+    }
+    else {
+        *p++ = (char)(0xF0 | (c >> 18));
+        *p++ = (char)(0x80 | ((c >> 12) & 0x3F));
+        *p++ = (char)(0x80 | ((c >> 6) & 0x3F));
+        *p++ = (char)(0x80 | (c & 0x3F));
+    }
+
+    return p;
+}
+
+
+/// <summary>
+/// Copy the run of ASCII characters starting at text[i] to p, a vector at a time. Returns the
+/// number of characters copied, the rest of the run (less than a vector) is left to the caller
+/// </summary>
+static inline size_t CopyASCIIRun(char* p, const wchar_t* text, size_t i, size_t length) {
+
+    size_t start = i;
+
+#ifdef UTF8_SSE2
+    const __m128i zero = _mm_setzero_si128();
+
+    if constexpr (sizeof(wchar_t) == 2) {
+        const __m128i nonASCII = _mm_set1_epi16((short)0xFF80);
+        while (i + 8 <= length) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(text + i));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, nonASCII), zero)) != 0xFFFF)
+                break;
+
+            _mm_storel_epi64((__m128i*)(p + (i - start)), _mm_packus_epi16(v, v));
+            i += 8;
+        }
+    }
+    else {
+        const __m128i nonASCII = _mm_set1_epi32((int)0xFFFFFF80);
+        while (i + 4 <= length) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(text + i));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(v, nonASCII), zero)) != 0xFFFF)
+                break;
+
+            __m128i words = _mm_packs_epi32(v, v);
+            int32_t bytes = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+            memcpy(p + (i - start), &bytes, sizeof(bytes));
+            i += 4;
+        }
+    }
+#endif
+
+    return i - start;
+}
+
+
+void EMObsAppendUTF8(std::string& out, const wchar_t* text, size_t length) {
+
+    if (length == 0)
+        return;
+
+    // Room for the worst case, trimmed at the end
+    size_t start = out.size();
+    out.resize(start + length * (sizeof(wchar_t) == 2 ? 3 : 4));
+    char* p = &out[start];
+
+    size_t i = 0;
+    while (i < length) {
+        size_t copied = CopyASCIIRun(p, text, i, length);
+        p += copied;
+        i += copied;
+        if (i >= length)
+            break;
+
+        uint32_t c = (uint32_t)text[i++];
+
+        if (c >= 0xD800 && c <= 0xDFFF) {
+            // A high surrogate followed by a low surrogate is one character
+            uint32_t low = i < length ? (uint32_t)text[i] : 0;
+            if (sizeof(wchar_t) == 2 && c <= 0xDBFF && low >= 0xDC00 && low <= 0xDFFF) {
+                c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+                i++;
+            }
+            else
+                c = UTF8_REPLACEMENT;
+        }
+        else if (c > 0x10FFFF)
+            c = UTF8_REPLACEMENT;
+
+        p = EncodeUTF8(p, c);
+    }
+
+    out.resize(p - out.data());
+}
+
+
+std::string EMObsToUTF8(const std::wstring& text) {
+
+    std::string out;
+    EMObsAppendUTF8(out, text.data(), text.size());
+    return out;
+}
+
+
+std::wstring EMObsFromUTF8(const std::string& text) {
+
+    std::wstring out;
+    out.reserve(text.size());
+
+    size_t length = text.size();
+    size_t i = 0;
+    while (i < length) {
+        unsigned char b = (unsigned char)text[i];
+
+        if (b < 0x80) {
+            out += (wchar_t)b;
+            i++;
+            continue;
+        }
+
+        int extra;
+        uint32_t c;
+        uint32_t min;
+        if ((b & 0xE0) == 0xC0) {
+            extra = 1; c = b & 0x1F; min = 0x80;
+        }
+        else if ((b & 0xF0) == 0xE0) {
+            extra = 2; c = b & 0x0F; min = 0x800;
+        }
+        else if ((b & 0xF8) == 0xF0) {
+            extra = 3; c = b & 0x07; min = 0x10000;
+        }
+        else {
+            out += (wchar_t)UTF8_REPLACEMENT;
+            i++;
+            continue;
+        }
+
+        bool ok = i + extra < length;
+        for (int k = 1; ok && k <= extra; k++) {
+            unsigned char next = (unsigned char)text[i + k];
+            ok = (next & 0xC0) == 0x80;
+            c = (c << 6) | (next & 0x3F);
+        }
+
+        // Overlong forms, surrogates and values past U+10FFFF aren't valid UTF-8
+        if (!ok || c < min || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) {
+            out += (wchar_t)UTF8_REPLACEMENT;
+            i++;
+            continue;
+        }
+        i += extra + 1;
+
+        if (sizeof(wchar_t) == 2 && c >= 0x10000) {
+            c -= 0x10000;
+            out += (wchar_t)(0xD800 + (c >> 10));
+            out += (wchar_t)(0xDC00 + (c & 0x3FF));
+        }
+        else
+            out += (wchar_t)c;
+    }
+
+    return out;
+}
+
+
+std::string EMObsPathToUTF8(const std::filesystem::path& path) {
+
+    // u8string() is a std::u8string from C++20 on
+    auto text = path.u8string();
+    return std::string(text.begin(), text.end());
+}
+
+
+EMObsUTF8Writer::~EMObsUTF8Writer() {
+
+    Close();
+}
+
+bool EMObsUTF8Writer::Open(const std::filesystem::path& fileSpec, bool append) {
+
+    Close();
+
+    // Text mode, so the line ends are the usual ones for the platform
+    file.open(fileSpec, std::ios::out | (append ? std::ios::app : std::ios::trunc));
+    return file.is_open();
+}
+
+bool EMObsUTF8Writer::IsOpen() const {
+
+    return file.is_open();
+}
+
+void EMObsUTF8Writer::Close() {
+
+    if (file.is_open()) {
+        Flush();
+        file.close();
+    }
+    buffer.clear();
+}
+
+void EMObsUTF8Writer::Write(const char* text, size_t length) {
+
+    // Large blocks go straight to the file
+    if (length >= UTF8_BLOCK_SIZE) {
+        Flush();
+        if (file.is_open())
+            file.write(text, (std::streamsize)length);
+        return;
+    }
+
+    buffer.append(text, length);
+    if (buffer.size() >= UTF8_BLOCK_SIZE)
+        Flush();
+}
+
+EMObsUTF8Writer& EMObsUTF8Writer::operator<<(const std::wstring& text) {
+
+    EMObsAppendUTF8(buffer, text.data(), text.size());
+    if (buffer.size() >= UTF8_BLOCK_SIZE)
+        Flush();
+    return *this;
+}
+
+EMObsUTF8Writer& EMObsUTF8Writer::operator<<(const wchar_t* text) {
+
+    EMObsAppendUTF8(buffer, text, wcslen(text));
+    if (buffer.size() >= UTF8_BLOCK_SIZE)
+        Flush();
+    return *this;
+}
+
+EMObsUTF8Writer& EMObsUTF8Writer::operator<<(const std::string& text) {
+
+    Write(text.data(), text.size());
+    return *this;
+}
+
+EMObsUTF8Writer& EMObsUTF8Writer::operator<<(const char* text) {
+
+    Write(text, strlen(text));
+    return *this;
+}
+
+void EMObsUTF8Writer::Flush() {
+
+    if (file.is_open() && !buffer.empty())
+        file.write(buffer.data(), (std::streamsize)buffer.size());
+    buffer.clear();
+}
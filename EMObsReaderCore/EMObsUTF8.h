@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+
+// UTF-8 conversion of the wide strings (UTF-16 on Windows, UTF-32 where wchar_t is 32 bits).
+// Runs of ASCII, most of the text written, are converted 8 (or 4) characters at a time with SSE2
+// Unpaired surrogates and invalid UTF-8 become U+FFFD
+void EMObsAppendUTF8(std::string& out, const wchar_t* text, size_t length);
+std::string EMObsToUTF8(const std::wstring& text);
+std::wstring EMObsFromUTF8(const std::string& text);
+
+// A path as UTF-8. On Windows a path built from a std::string is in the ANSI code page, not UTF-8
+std::string EMObsPathToUTF8(const std::filesystem::path& path);
+
+
+/// <summary>
+/// Output text file written as UTF-8 (without a BOM). The wide strings are converted straight
+/// into a buffer which is written to the file a block at a time, so there is no locale or
+/// codecvt facet involved as with a std::wofstream
+/// </summary>
+class EMObsUTF8Writer {
+public:
+    EMObsUTF8Writer() = default;
+    ~EMObsUTF8Writer();
+
+    bool Open(const std::filesystem::path& fileSpec, bool append = false);
+    bool IsOpen() const;
+    void Close();
+
+    // Write text that is already UTF-8
+    void Write(const char* text, size_t length);
+
+    EMObsUTF8Writer& operator<<(const std::wstring& text);
+    EMObsUTF8Writer& operator<<(const wchar_t* text);
+    EMObsUTF8Writer& operator<<(const std::string& text);
+    EMObsUTF8Writer& operator<<(const char* text);
+
+    // Write the buffered text to the file
+    void Flush();
+
+private:
+    std::ofstream file;
+    std::string buffer;
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "EMObsRecords.h"
+
+
+/// <summary>
+/// Streaming (SAX style) callbacks for EMObsReader::Parse(). The records are passed to the visitor
+/// as they are decoded and are only valid for the duration of the call, the reader does not build
+/// a tree of the whole file. Each IDA is decoded in full before its callbacks are made (the period
+/// name comes after the 2D points in the file) and then released.
+/// Return false from any callback to stop the parse.
+/// </summary>
+class EMObsVisitor {
+public:
+    virtual ~EMObsVisitor() {}
+
+    // Once per file. pCIN (the opcode data) and pPTN (the field titles) are nullptr if they could
+    // not be decoded
+    virtual bool onHeader(const struct _EBS& EBS, const struct _CIN* pCIN, const struct _PTN* pPTN) { return true; }
+
+    // Once per IDA, before its points. FRA is the IDA's frame (normally the left camera)
+    virtual bool onFrame(const struct _IDA& IDA, const struct _FRA& FRA) { return true; }
+
+    // 2D point in the left or right camera frame
+    virtual bool on2DPoint(const struct _IDA& IDA, const struct _PDA& PDA) { return true; }
+
+    // 3D measurement (two points in each of the left and right camera frames)
+    virtual bool on3DMeasurement(const struct _IDA& IDA, const struct _PDL& PDL) { return true; }
+
+    // 3D point (one point in each of the left and right camera frames)
+    virtual bool on3DPoint(const struct _IDA& IDA, const struct _PD3& PD3) { return true; }
+};
+
+
+// A TLC found by EMObsReader::ScanTLCs(), only valid for the duration of the call
+struct EMObsTLCItem {
+    int row;                            // 1 based within the file
+    long seekOffset;                    // Offset of the TLC
+    char cTLC[3];
+    char cTLCVersion;                   // The byte after the TLC
+    bool hasFrame;                      // An FRA that decoded, the two values below are set
+    int32_t iCameraZeroLeftOneRight;
+    int32_t iFrameIndex;
+};
+
+
+/// <summary>
+/// Callback for EMObsReader::ScanTLCs(). Each TLC candidate in the file is passed in file order as
+/// it is found, nothing is kept for the whole file. Return false to stop the scan.
+/// </summary>
+class EMObsTLCVisitor {
+public:
+    virtual ~EMObsTLCVisitor() {}
+
+    virtual bool onTLC(const EMObsTLCItem& item) = 0;
+};
@@ -15,6 +15,7 @@
 #include <vector>
 #include <string>
 #include <cctype>
+#include <cwctype>
 #include <algorithm>
 #include <list>
 #include <fstream>